@@ -2,26 +2,83 @@
 
 #define FLDSEP " | "
 #define MAXCOLSZ 19
+#define HISTSIZE 500
 
-static const char *dbhost = "";
-static const char *dbuser = "";
-static const char *dbpass = "";
+/* threads used to sort large views, 0 means one per online CPU */
+static const int sortthreads = 0;
 
-/* gets executed when myadm is started */
+/* bytes of rows kept in memory per view, the rest is spilled to a mapped
+ * temporary file; 0 means no limit */
+static const size_t rambudget = 256 << 20;
+
+/* directory of the spilled rows, NULL means the cache directory below: /tmp
+ * is often held in memory */
+static const char *spilldir = NULL;
+
+/* bytes of items kept by all the views in the stack, the least recently shown
+ * views are dropped and reloaded on return past it; 0 means no limit */
+static const size_t viewbudget = 512 << 20;
+
+/* where the schema indexes and the SQL history are kept, NULL means $XDG_CACHE_HOME/myadm or
+ * ~/.cache/myadm */
+static const char *cachedir = NULL;
+
+/* show the engine, rows and sizes of tables by default, toggled with 's' */
+static const int statusdefault = 0;
+
+/* seconds between refreshes of a watched view, the default asked for */
+static const double watchinterval = 2;
+/* largest table, in rows, probed with CHECKSUM TABLE before being queried
+ * again when watched, unless filtered */
+static const int watchprobemax = 100000;
+
+/* rows per chunk and connections per server when comparing tables */
+static const int chunkrows = 10000;
+static const int comparethreads = 4;
+
+/* bytes per INSERT and INSERTs queued ahead of the writer when copying */
+static const size_t copybatch = 1 << 20;
+static const int copyqueue = 8;
+
+/* seconds between refreshes of the locks view */
+static const double lockinterval = 2;
+
+/* connection profiles, the first one is connected at startup and can be set
+ * with the -h, -u and -p options */
+static Profile profiles[] = {
+	/* name          host          user          pass */
+	{ "default",     "",           "",           "" },
+};
+
+/* gets executed when myadm is started, the queries are run ahead while
+ * connecting and their results used by the first views */
 static Action actions[] = {
-	{ viewdblist },
+	/* function        query */
+	{ viewserverlist,  NULL },
+	{ viewdblist,      "show databases" },
 };
 
 static Key keys[] = {
 	/* view          key           function        argument */
-        { "databases",   'q',          quit,           {.i = 0} },
+        { "servers",     'q',          quit,           {.i = 0} },
+        { "servers",     '\n',         viewserver,     {0} },
+        { "servers",     ' ',          viewserver,     {0} },
         { "databases",   '\n',         viewdb,         {0} },
         { "databases",   ' ',          viewdb,         {0} },
+        { "databases",   'C',          compare,        {0} },
         { "tables",      '\n',         viewtable,      {0} },
         { "tables",      ' ',          viewtable,      {0} },
         { "tables",      'e',          edittable,      {0} },
+        { "tables",      'C',          compare,        {0} },
+        { "tables",      'c',          copytable,      {0} },
+        { "tables",      's',          tablestatus,    {0} },
         { "records",     'e',          editrecord,     {0} },
         { "records",     ' ',          editrecord,     {0} },
+        { "records",     'w',          filtertable,    {0} },
+        { "comparedb",   '\n',         viewcompare,    {0} },
+        { "comparedb",   ' ',          viewcompare,    {0} },
+        { "locks",       'K',          killblocker,    {0} },
+        { "sql",         'e',          sqledit,        {0} },
         { NULL,          CTRL('c'),    quit,           {.i = 1} },
         { NULL,          'Q',          quit,           {.i = 1} },
         { NULL,          'q',          viewprev,       {0} },
@@ -36,4 +93,16 @@ static Key keys[] = {
         { NULL,          KEY_PPAGE,    itempos,        {.i = -20} },
         { NULL,          'g',          itempos,        {.i = -9999} },
         { NULL,          'G',          itempos,        {.i = +9999} },
+        { NULL,          '/',          search,         {.i = +1} },
+        { NULL,          '?',          search,         {.i = -1} },
+        { NULL,          'n',          searchnext,     {.i = +1} },
+        { NULL,          'N',          searchnext,     {.i = -1} },
+        { NULL,          'l',          limit,          {0} },
+        { NULL,          'F',          fanout,         {0} },
+        { NULL,          ':',          sqlprompt,      {0} },
+        { NULL,          'E',          sqledit,        {0} },
+        { NULL,          'W',          watch,          {0} },
+        { NULL,          'L',          viewlocks,      {0} },
+        { NULL,          'o',          sortview,       {.i = +1} },
+        { NULL,          'O',          sortview,       {.i = -1} },
 };
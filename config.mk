@@ -9,10 +9,10 @@ MANPREFIX = ${PREFIX}/share/man
 
 # includes and libs
 INCS = `mysql_config --cflags`
-LIBS = -lmysqlclient -lstfl -lncursesw
+LIBS = -lmysqlclient -lstfl -lncursesw -lpthread
 
 # flags
-CPPFLAGS = -D_DEFAULT_SOURCE -D_POSIX_C_SOURCE=2 -DVERSION=\"${VERSION}\"
+CPPFLAGS = -D_DEFAULT_SOURCE -D_POSIX_C_SOURCE=2 -D_XOPEN_SOURCE=700 -DVERSION=\"${VERSION}\"
 CFLAGS   = -std=c99 -g -pedantic -Wall -O0 ${INCS} ${CPPFLAGS}
 #CFLAGS  = -std=c99 -pedantic -Wall -Wno-deprecated-declarations -Os ${INCS} ${CPPFLAGS}
 LDFLAGS  = -s ${LIBS}
@@ -6,7 +6,22 @@
  * Each piece of information displayed is called an item. Items are organized
  * in a linked items list on each view. A view contains an STFL form where all
  * graphical elements are drawn along with all related informations. Each item
- * contains a bit array to indicate tags of an item.
+ * contains a bit array to indicate tags of an item. The columns of an item are
+ * packed in a single block (see packrow()) which lives right after the item.
+ * Past the memory budget of the view, rows are packed the same way in a mapped
+ * temporary file instead and get no item, see rowitem().
+ *
+ * The rows of a view are indexes into its items array, followed by its spilled
+ * rows: they are what is actually listed, so limiting or sorting a view never
+ * touches the items themselves. Only the rows fitting the screen are handed to
+ * STFL.
+ *
+ * Each view talks to the server of the connection profile it was opened on;
+ * mysql always points to the connection of the selected view.
+ *
+ * The names of the databases and tables of each profile are kept in a schema
+ * index file under the cache directory, mapped and listed right away while a
+ * thread checks it against the server and rewrites what changed.
  *
  * To understand everything else, start reading main().
 */
@@ -14,20 +29,31 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
 #include <signal.h>
 #include <ctype.h>
+#include <limits.h>
 #include <mysql.h>
 #include <stfl.h>
 #include <langinfo.h>
 #include <locale.h>
 #include <curses.h>
+#include <wchar.h>
+#include <wctype.h>
 
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+
+#if defined __AVX2__ || defined __SSE2__
+#include <immintrin.h>
+#endif
 
 /* STFL fragments (generated via stflfrag) */
 #include "fragments.h"
@@ -35,12 +61,16 @@
 #include "arg.h"
 char *argv0;
 
-#define QUOTE(S)		(stfl_ipool_fromwc(ipool, stfl_quote(stfl_ipool_towc(ipool, S))))
 #define ISCURVIEW(N)		!(N && selview && strcmp(selview->name, N))
 #define LENGTH(X)		(sizeof X / sizeof X[0])
+#define ITEMLEN(I, N)		(((int *)(I)->data)[N])
+#define ITEMWIDTH(I, N)		(((int *)(I)->data)[(I)->ncols + (N)])
+#define ITEMCOL(I, N)		((I)->data + ((int *)(I)->data)[2 * (I)->ncols + (N)])
 
 #define MYSQLIDLEN		64
 #define MAXQUERYLEN		4096
+#define MAXKEYCOLS		16
+#define MAXPATLEN		128
 
 typedef union {
 	int i;
@@ -51,12 +81,12 @@ typedef union {
 
 typedef struct {
 	void (*cmd)(void);
+	const char *query;
 } Action;
 
 typedef struct Item Item;
 struct Item {
-	char **cols;
-	int *lens;
+	char *data;
 	int ncols;
 	Item *next;
 };
@@ -65,9 +95,136 @@ typedef struct Field Field;
 struct Field {
 	char name[MYSQLIDLEN];
 	int len;
+	int width;
+	enum enum_field_types type;
 	Field *next;
 };
 
+typedef struct {
+	const char *name;
+	const char *host;
+	const char *user;
+	const char *pass;
+} Profile;
+
+/* schema index file: a SchemaHdr, the SchemaDb of each database sorted by
+ * name, the offsets of the names of their tables and then all the strings,
+ * offsets being counted from the start of the file */
+typedef struct {
+	char magic[8];
+	unsigned int ndbs;
+	unsigned int ntables;
+} SchemaHdr;
+
+typedef struct {
+	unsigned int name;
+	unsigned int sig;
+	unsigned int first;
+	unsigned int ntables;
+} SchemaDb;
+
+typedef struct {
+	char *map;
+	size_t size;
+	int state;
+	pthread_t tid;
+} Schema;
+
+typedef struct {
+	unsigned long long count[2];
+	unsigned long long sum[2];
+} Chunk;
+
+/* a table compared between two profiles, split in chunks on its unique key,
+ * with comparethreads connections to each */
+typedef struct {
+	int conn[2];
+	MYSQL **m[2];
+	char tbl[MYSQLIDLEN*2+6];
+	char key[4 * MYSQLIDLEN];
+	char *keys;
+	char *sumsql;
+	char *rowsql;
+	Field *fields;
+	int nfields;
+	char **bounds;
+	int nbounds;
+	Chunk *chunks;
+	int nchunks;
+	int next[2];
+	pthread_mutex_t lock;
+	char err[256];
+} Compare;
+
+typedef struct {
+	Compare *c;
+	MYSQL *m;
+	int side;
+	pthread_t tid;
+	int spawned;
+} CompareJob;
+
+typedef struct {
+	char *sql;
+	size_t len;
+	int nrows;
+} Batch;
+
+/* a table copied by a reader thread, turning rows into multi-row INSERTs,
+ * and a writer thread running them, through a queue of copyqueue batches */
+typedef struct {
+	int conn;
+	MYSQL *src, *dst;
+	char from[MYSQLIDLEN*2+6];
+	char to[MYSQLIDLEN*2+6];
+	char *sql;
+	Batch *queue;
+	int head, count;
+	pthread_mutex_t lock;
+	pthread_cond_t notempty, notfull;
+	pthread_t tid[2];
+	int spawned[2];
+	int state, finished, eof, stop, killed;
+	unsigned long long rows, total;
+	size_t bytes;
+	double start;
+	char err[256];
+} Copy;
+
+typedef struct {
+	char *key;
+	char *sum;
+	MYSQL_ROW row;
+	unsigned long *lens;
+} DiffRow;
+
+typedef struct {
+	MYSQL_ROW row;
+	unsigned long *lens;
+	int parent;
+	int nwait;
+	int done;
+} LockTrx;
+
+/* the query of the locks view, run on a connection of its own so that a
+ * stalled server does not freeze the UI, see trxpoll() */
+typedef struct {
+	MYSQL *m;
+	int conn;
+	MYSQL_RES *res;
+	char err[256];
+	int state;
+	pthread_t tid;
+} TrxJob;
+
+typedef struct {
+	char *name;
+	char *sig;
+	char **tables;
+	int ntables;
+	int changed;
+} Db;
+
 typedef struct {
 	const char *view;
 	const int code;
@@ -76,15 +233,72 @@ typedef struct {
 } Key;
 
 typedef struct View View;
+
+typedef struct {
+	View *v;
+	double *keys;
+	int col;
+	int dir;
+} Sort;
+
+typedef struct {
+	const Sort *s;
+	int *src, *dst;
+	int lo, mid, hi;
+	pthread_t tid;
+	int spawned;
+} SortJob;
+
+typedef struct {
+	int conn;
+	const char *sql;
+	MYSQL_RES *res;
+	char err[256];
+	pthread_t tid;
+	int spawned;
+} FanJob;
+
 struct View {
 	char name[16];
 	void (*show)(void);
 	Item *items;
+	Item **all;
 	Item *choice;
+	char *query;
 	Field *fields;
+	int *order;
+	int *rows;
+	int *lens;
+	char filter[MAXPATLEN];
+	char where[MAXPATLEN*4];
+	char *sbuf;
+	size_t *soff;
+	size_t sbufsz;
+	int sbufmapped;
+	char *spill;
+	size_t spillsz;
+	size_t *spilloff;
+	int *spillw;
+	int spillcols;
+	int nspill;
+	size_t ram;
+	unsigned int *seen;
+	char *changed;
+	char probe[32];
+	double watch;
+	double watched;
+	unsigned long used;
+	int evicted;
+	int conn;
+	int peer;
 	int cur;
+	int top;
 	int nitems;
+	int nram;
+	int nrows;
 	int nfields;
+	int sortcol;
+	int sortdir;
 	struct stfl_form *form;
 	View *next;
 };
@@ -94,10 +308,39 @@ void attach(View *v);
 void attachfield(Field *f, Field **ff);
 void attachitem(Item *i, Item **ii);
 char ui_ask(const char *msg, char *opts);
+void cachedirs(const char *path);
+void cachepath(const char *name, char *buf, int sz);
 void cleanup(void);
 void cleanupfields(Field **fields);
 void cleanupitems(Item **items);
+void cleanuprows(View *v);
+void cleanupspill(View *v);
 void cleanupview(View *v);
+int cmpdb(const void *a, const void *b);
+int cmpstr(const void *a, const void *b);
+int cmpuint(const void *a, const void *b);
+int cmpdiff(const void *a, const void *b);
+void compare(const Arg *arg);
+void compareclear(Compare *c);
+void compareclose(Compare *c);
+int compareinit(Compare *c, const char *db, const char *tbl);
+void *compare_job(void *job);
+void copyfail(Copy *c, const char *err);
+void copyfree(Copy *c);
+int copyinit(Copy *c, int dconn, const char *ddb, const char *db, const char *tbl);
+void copypoll(void);
+int copypush(Copy *c, Batch *b);
+void *copy_reader(void *arg);
+void copytable(const Arg *arg);
+void *copy_writer(void *arg);
+int compareopen(Compare *c, int a, int b);
+char *comparequery(Compare *c, int chunk, const char *sql, const char *cond);
+int comparerange(Compare *c, int chunk, const char *cond, View *v, Item ***tail);
+int comparerows(Compare *c, int chunk, View *v, Item ***tail);
+int comparerun(Compare *c);
+int comparesplit(Compare *c);
+MYSQL *dbconnect(int conn, char *err, int sz);
+MYSQL *dbopen(int conn, char *err, int sz);
 void detach(View *v);
 void detachfield(Field *f, Field **ff);
 void detachitem(Item *i, Item **ii);
@@ -106,43 +349,131 @@ void *ecalloc(size_t nmemb, size_t size);
 void editfile(char *file);
 void editrecord(const Arg *arg);
 void edittable(const Arg *arg);
+void evict(View *v);
+void fanout(const Arg *arg);
+void *fanout_job(void *job);
 int escape(char *esc, char *s, int sz, char c, char skip);
+void filterrows(View *v, const char *pat);
+void fmtbytes(char *buf, int sz, size_t n);
+void framegrow(size_t n);
+void frameputs(const char *s, int len, int rich);
+void framewcs(const wchar_t *ws);
+void filtertable(const Arg *arg);
+int findrow(const char *pat, int from, int dir);
 Item *getitem(int pos);
+void govern(void);
+void histadd(const char *sql);
+const char *histget(int n);
+void histload(void);
+void histsave(void);
+int isprintascii(const char *s, int len);
+Item *itemdup(Item *item);
+unsigned int itemhash(Item *item);
+size_t itemsize(Item *item);
 int *getmaxlengths(Item *items, Field *fields);
 void itempos(const Arg *arg);
+void killblocker(const Arg *arg);
+void limit(const Arg *arg);
+void limit_update(const char *pat);
+void lockadd(View *v, LockTrx *t, int n, int i, int depth, int root, Item ***tail);
+void lockstree(View *v, MYSQL_RES *res, const char *err);
+const char *memfind(const char *s, size_t n, const char *p, size_t m);
+Field *mkfield(const char *name, enum enum_field_types type);
+Item *mkitem(View *v, char **cols, unsigned long *lens, int ncols);
+void mkrows(View *v);
 void mksql_alter_table(char *sql, char *tbl);
 void mksql_update(char *sql, Item *item, Field *fields, char *tbl, char *uk);
+void mksql_where(char *sql, int sz, const char *clause, Field *fields);
 int mysql_file_exec(char *file);
 int mysql_exec(const char *sqlstr, ...);
+int mysql_explain(const char *sql, unsigned long long *rows, int *fullscan);
 int mysql_fields(MYSQL_RES *res, Field **fields);
 void mysql_fillview(MYSQL_RES *res, int showfds);
+MYSQL_RES *mysql_store(const char *sql);
+double now(void);
 int mysql_ukey(char *key, char *tbl, int sz);
-int mysql_items(MYSQL_RES *res, Item **items);
+int mysql_ukeys(const char *tbl, char (*cols)[4 * MYSQLIDLEN], int max);
+int mysql_items(MYSQL_RES *res, View *v);
+void msort(const Sort *s, int *a, int *tmp, int n);
+void *msort_job(void *job);
+void merge(const Sort *s, const int *a, int na, const int *b, int nb, int *out);
+void *merge_job(void *job);
+void packrow(char *data, MYSQL_ROW row, unsigned long *lens, int ncols);
+int putcell(char *buf, int sz, const char *s, int len, int w);
 void quit(const Arg *arg);
 void reload(const Arg *arg);
+int rowmatch(View *v, int id, const char *pat, size_t m);
+void *rowalloc(View *v, size_t nmemb, size_t size);
+void rowfree(void *p);
+Item *rowitem(View *v, int id, Item *tmp);
+size_t rowsize(unsigned long *lens, int ncols);
 void run(void);
+void schemaclose(int conn);
+SchemaDb *schemadb(const char *map, const char *name);
+int schemafill(View *v, const char *db);
+void *schema_job(void *arg);
+void schemaopen(int conn);
+void schemapath(int conn, char *buf, int sz);
+void schemapoll(void);
+void schemarefresh(int conn);
+int schemawrite(const char *path, Db *dbs, int ndbs);
+void search(const Arg *arg);
+void search_update(const char *pat);
+void searchbuf(View *v);
+void searchnext(const Arg *arg);
+void setpos(int pos);
 void setview(const char *name, void (*func)(void));
+int sortcmp(const Sort *s, int x, int y);
+void sortrows(View *v);
+FILE *spillfile(void);
+void sortview(const Arg *arg);
+void sqledit(const Arg *arg);
+void sqlprompt(const Arg *arg);
+void sqlrun(const char *sql);
+void tablestatus(const Arg *arg);
 void setup(void);
 void startup(void);
+void *startup_job(void *arg);
+int strwidth(const char *s, int len);
+void *trx_job(void *arg);
+void trxpoll(void);
 void ui_end(void);
 struct stfl_form *ui_getform(wchar_t *code);
 void ui_init(void);
-void ui_modify(const char *name, const char *mode, const char *fmtstr, ...);
+int ui_input(const char *prompt, char *buf, int sz, int hist, void (*update)(const char *));
+int ui_listheight(void);
 void ui_listview(Item *items, Field *fields);
-void ui_putitem(Item *item, int *lens, int id);
+void ui_putitem(Item *item, int *lens, int id, int hl);
 void ui_refresh(void);
 void ui_set(const char *key, const char *fmtstr, ...);
 void ui_showfields(Field *fds, int *lens);
-void ui_showitems(Item *items, int *lens);
+void ui_showitems(int *lens);
 void ui_sql_edit_exec(char *sql);
 void usage(void);
+void useconn(int conn);
+size_t viewbytes(View *v);
+void viewcompare(const Arg *arg);
+void viewcompare_show(void);
+void viewcomparedb_show(void);
 void viewdb(const Arg *arg);
+void viewfanout_show(void);
+void viewlocks(const Arg *arg);
+void viewlocks_show(void);
+void viewserver(const Arg *arg);
+void viewserverlist(void);
+void viewserverlist_show(void);
 void viewdb_show(void);
 void viewdblist(void);
 void viewdblist_show(void);
 void viewprev(const Arg *arg);
+void viewsql_show(void);
 void viewtable(const Arg *arg);
 void viewtable_show(void);
+void watch(const Arg *arg);
+void watchmark(View *v);
+void watchpoll(void);
+int watchprobe(View *v);
+void watchseen(View *v);
 
 #if defined CTRL && defined _AIX
   #undef CTRL
@@ -156,10 +487,32 @@ void viewtable_show(void);
 
 /* variables */
 static int running = 1;
-static MYSQL *mysql;
+static MYSQL *mysql, *conns[LENGTH(profiles)];
+static int curconn;
+static int verbose;
+static int showstatus;
+static char *history[HISTSIZE];
+static int histhead, histlen;
+static struct stfl_form *splash;
+static pthread_t startthread;
+static pthread_mutex_t startlock = PTHREAD_MUTEX_INITIALIZER;
+static int starting, started, startspawned;
+static char starterr[256];
+static MYSQL_RES *prefetched[LENGTH(actions)];
+static double tstart, tui, tconnect, tprefetch, tview;
+static Schema schemas[LENGTH(profiles)];
+static pthread_mutex_t schemalock = PTHREAD_MUTEX_INITIALIZER;
+static Copy copy;
+static pthread_mutex_t trxlock = PTHREAD_MUTEX_INITIALIZER;
+static TrxJob trxjob;
 static View *views, *selview = NULL;
 static struct stfl_ipool *ipool;
+static wchar_t *frame;
+static size_t framelen, framesz;
 static int fldseplen;
+static char searchpat[MAXPATLEN];
+static int searchdir = +1, searchfrom;
+static unsigned long tick;
 
 /* function implementations */
 void
@@ -211,17 +564,45 @@ ui_ask(const char *msg, char *opts) {
 
 void
 cleanup(void) {
+	int i;
+
+	if(starting) {
+		/* quit while connecting, leave the connection thread be */
+		ui_end();
+		return;
+	}
 	while(views)
 		cleanupview(views);
 	ui_end();
-	mysql_close(mysql);
+	for(i = 0; i < LENGTH(conns); ++i)
+		if(conns[i])
+			mysql_close(conns[i]);
+	if(trxjob.m && !trxjob.state)
+		mysql_close(trxjob.m);
+	for(i = 0; i < LENGTH(schemas); ++i)
+		if(schemas[i].state == 1)
+			break; /* still indexing, copying or listing locks, left to exit() */
+	if(i == LENGTH(schemas) && !copy.state && !trxjob.state) {
+		for(i = 0; i < LENGTH(schemas); ++i)
+			schemaclose(i);
+		mysql_library_end();
+	}
+	if(verbose)
+		fprintf(stderr, "startup: ui %.0fms, connect %.0fms, prefetch %.0fms, first view %.0fms\n",
+			tui * 1000, tconnect * 1000, tprefetch * 1000, tview * 1000);
 }
 
 void
 cleanupview(View *v) {
 	detach(v);
+	cleanuprows(v);
 	cleanupitems(&v->items);
+	cleanupspill(v);
 	cleanupfields(&v->fields);
+	free(v->lens);
+	free(v->choice);
+	free(v->query);
+	rowfree(v->seen);
 	if(v->form)
 		stfl_free(v->form);
 	free(v);
@@ -245,502 +626,3271 @@ cleanupitems(Item **items) {
 	while(*items) {
 		i = *items;
 		detachitem(i, items);
-		while(--i->ncols >= 0)
-			free(i->cols[i->ncols]);
-		free(i->cols);
-		free(i->lens);
 		free(i);
 	}
 }
 
 void
-detach(View *v) {
-	View **tv;
-
-	for(tv = &views; *tv && *tv != v; tv = &(*tv)->next);
-	*tv = v->next;
+cleanuprows(View *v) {
+	free(v->all);
+	rowfree(v->order);
+	rowfree(v->rows);
+	if(v->sbufmapped)
+		munmap(v->sbuf, v->sbufsz);
+	else
+		free(v->sbuf);
+	rowfree(v->soff);
+	rowfree(v->changed);
+	v->all = NULL;
+	v->order = NULL;
+	v->rows = NULL;
+	v->sbuf = NULL;
+	v->soff = NULL;
+	v->changed = NULL;
+	v->sbufsz = 0;
+	v->sbufmapped = 0;
+	v->nram = 0;
+	v->nrows = 0;
 }
 
 void
-detachfield(Field *f, Field **ff) {
-	Field **tf;
-
-	for(tf = &(*ff); *tf && *tf != f; tf = &(*tf)->next);
-	*tf = f->next;
+cleanupspill(View *v) {
+	if(v->spill) {
+		munmap(v->spill, v->spillsz);
+		munmap(v->spilloff, v->nspill * sizeof(size_t));
+	}
+	free(v->spillw);
+	v->spill = NULL;
+	v->spillsz = 0;
+	v->spilloff = NULL;
+	v->spillw = NULL;
+	v->spillcols = 0;
+	v->nspill = 0;
+	v->ram = 0;
 }
 
 void
-detachitem(Item *i, Item **ii) {
-	Item **ti;
+cachepath(const char *name, char *buf, int sz) {
+	const char *home = getenv("HOME"), *xdg = getenv("XDG_CACHE_HOME");
 
-	for(ti = &(*ii); *ti && *ti != i; ti = &(*ti)->next);
-	*ti = i->next;
+	if(cachedir)
+		snprintf(buf, sz, "%s/%s", cachedir, name);
+	else if(xdg && *xdg)
+		snprintf(buf, sz, "%s/myadm/%s", xdg, name);
+	else
+		snprintf(buf, sz, "%s/.cache/myadm/%s", (home ? home : "."), name);
 }
 
+/* Create the missing directories leading to path. */
 void
-die(const char *errstr, ...) {
-	va_list ap;
+cachedirs(const char *path) {
+	char dir[PATH_MAX], *p;
 
-	va_start(ap, errstr);
-	vfprintf(stderr, errstr, ap);
-	va_end(ap);
-	exit(1);
+	snprintf(dir, sizeof dir, "%s", path);
+	for(p = &dir[1]; (p = strchr(p, '/')); *p++ = '/') {
+		*p = '\0';
+		mkdir(dir, 0700);
+	}
 }
 
-void *
-ecalloc(size_t nmemb, size_t size) {
-	void *p;
-
-	if (!(p = calloc(nmemb, size)))
-		die("Cannot allocate memory.\n");
-	return p;
+int
+cmpdb(const void *a, const void *b) {
+	return strcmp(((Db *)a)->name, ((Db *)b)->name);
 }
 
-void
-editfile(char *file) {
-        pid_t pid;
-	int rc = -1;
-	struct sigaction saold[4];
-
-	/* take off ncurses signal handlers */
-	struct sigaction sa = {.sa_flags = 0, .sa_handler = SIG_DFL};
-	sigaction(SIGINT, &sa, &saold[0]);
-	sigaction(SIGTERM, &sa, &saold[1]);
-	sigaction(SIGTSTP, &sa, &saold[2]);
-	sigaction(SIGWINCH, &sa, &saold[3]);
+int
+cmpstr(const void *a, const void *b) {
+	return strcmp(*(char **)a, *(char **)b);
+}
 
-        if((pid = fork()) == 0) {
-                execl("/bin/sh", "sh", "-c", "$EDITOR \"$0\"", file, NULL);
-                _exit(127);
-        }
-	else if(pid == -1)
-		return;
-	while(!WIFEXITED(rc))
-		waitpid(pid, &rc, 0);
+int
+cmpuint(const void *a, const void *b) {
+	unsigned int x = *(unsigned int *)a, y = *(unsigned int *)b;
 
-	/* restore ncurses signal handlers */
-	sigaction(SIGINT, &saold[0], NULL);
-	sigaction(SIGTERM, &saold[1], NULL);
-	sigaction(SIGTSTP, &saold[2], NULL);
-	sigaction(SIGWINCH, &saold[3], NULL);
+	return (x > y) - (x < y);
+}
 
-	/* reinitialize ncurses */
-	endwin();
-	refresh();
+int
+cmpdiff(const void *a, const void *b) {
+	return strcmp(((DiffRow *)a)->key, ((DiffRow *)b)->key);
 }
 
+/* Compare the selected table, or all the tables of the selected database,
+ * with the same on another server. */
 void
-editrecord(const Arg *arg) {
-	Item *item = getitem(0);
-	char *tbl = selview->choice->cols[0], uk[MYSQLIDLEN+1], sql[MAXQUERYLEN+1];
+compare(const Arg *arg) {
+	char name[MYSQLIDLEN] = "";
+	int peer, db = ISCURVIEW("databases");
 
-	if(!item) {
-		ui_set("status", "No item selected.");
+	if(!getitem(0)) {
+		ui_set("status", (db ? "No database selected." : "No table selected."));
 		return;
 	}
-	if(mysql_ukey(uk, tbl, sizeof uk)) {
-		ui_set("status", "Cannot edit records in `%s`, no unique key found.", tbl);
+	if(LENGTH(profiles) == 2)
+		snprintf(name, sizeof name, "%s", profiles[!selview->conn].name);
+	if(ui_input("Compare with server: ", name, sizeof name, 0, NULL) <= 0)
+		return;
+	for(peer = 0; peer < LENGTH(profiles) && strcmp(profiles[peer].name, name); ++peer);
+	if(peer == LENGTH(profiles)) {
+		ui_set("status", "No such server: %s.", name);
 		return;
 	}
-	mksql_update(sql, item, selview->fields, tbl, uk);
-	ui_sql_edit_exec(sql);
+	if(peer == selview->conn) {
+		ui_set("status", "Cannot compare `%s` with itself.", name);
+		return;
+	}
+	setview((db ? "comparedb" : "compare"), NULL);
+	selview->peer = peer;
+	selview->show = (db ? viewcomparedb_show : viewcompare_show);
+	reload(NULL);
 }
 
+/* Forget the table being compared, keeping the connections. */
 void
-edittable(const Arg *arg) {
-	Item *item = getitem(0);
-	char sql[MAXQUERYLEN+1];
+compareclear(Compare *c) {
+	int i;
 
-	if(!item->cols[0]) {
-		ui_set("status", "No table selected.");
-		return;
+	for(i = 0; i < c->nbounds; ++i)
+		free(c->bounds[i]);
+	free(c->bounds);
+	free(c->chunks);
+	free(c->keys);
+	free(c->sumsql);
+	free(c->rowsql);
+	cleanupfields(&c->fields);
+	c->bounds = NULL;
+	c->chunks = NULL;
+	c->keys = c->sumsql = c->rowsql = NULL;
+	c->nbounds = c->nchunks = c->nfields = 0;
+}
+
+void
+compareclose(Compare *c) {
+	int i, j;
+
+	compareclear(c);
+	for(i = 0; i < 2; ++i) {
+		for(j = 0; c->m[i] && j < comparethreads; ++j)
+			if(c->m[i][j])
+				mysql_close(c->m[i][j]);
+		free(c->m[i]);
+		c->m[i] = NULL;
 	}
-	/* XXX check alter table permissions */
-	mksql_alter_table(sql, item->cols[0]);
-	ui_sql_edit_exec(sql);
+	pthread_mutex_destroy(&c->lock);
 }
 
+/* Set c up to compare db.tbl: its unique key, the queries checksumming a
+ * chunk and listing its rows, and its chunks. Rows are told apart by their
+ * key and checksummed as the CRC32 of all their columns, plus which of them
+ * are NULL; chunks as the count and BIT_XOR of the checksums of their rows,
+ * so that nothing but the rows which differ is sent over. */
 int
-escape(char *esc, char *s, int sz, char c, char skip) {
-	int i, ei = 0;
+compareinit(Compare *c, const char *db, const char *tbl) {
+	MYSQL_RES *res;
+	MYSQL_FIELD *fds;
+	char kcols[MAXKEYCOLS][4 * MYSQLIDLEN], *keys, *crc;
+	size_t csz = 64;
+	int nfds, nkeys, kl, cl, r, i;
 
-	for(i = 0; i < sz; ++i) {
-		if(s[i] == c && (!skip || s[i+1] != skip))
-			esc[ei++] = '\\';
-		esc[ei++] = s[i];
+	compareclear(c);
+	c->err[0] = '\0';
+	snprintf(c->tbl, sizeof c->tbl, "`%s`.`%s`", db, tbl);
+	if((nkeys = mysql_ukeys(c->tbl, kcols, MAXKEYCOLS)) <= 0) {
+		snprintf(c->err, sizeof c->err, "%s", (nkeys ? mysql_error(mysql) : "No unique key."));
+		return -1;
 	}
-	esc[ei] = '\0';
-	return ei - sz;
+	snprintf(c->key, sizeof c->key, "%s", kcols[0]);
+	keys = ecalloc(64 + nkeys * (sizeof kcols[0] + 4), 1);
+	c->keys = ecalloc(nkeys * (sizeof kcols[0] + 4), 1);
+	kl = sprintf(keys, "concat_ws(char(31)");
+	for(i = 0, r = 0; i < nkeys; ++i) {
+		kl += sprintf(&keys[kl], ", `%s`", kcols[i]);
+		r += sprintf(&c->keys[r], "%s`%s`", (i ? ", " : ""), kcols[i]);
+	}
+	sprintf(&keys[kl], ")");
+	r = mysql_exec("select * from %s limit 0", c->tbl);
+	if(r == -1 || !(res = mysql_store_result(mysql))) {
+		snprintf(c->err, sizeof c->err, "%s", mysql_error(mysql));
+		free(keys);
+		return -1;
+	}
+	nfds = mysql_num_fields(res);
+	fds = mysql_fetch_fields(res);
+	for(i = 0; i < nfds; ++i)
+		csz += 2 * fds[i].name_length + 16;
+	crc = ecalloc(csz, 1);
+	cl = sprintf(crc, "crc32(concat_ws(char(31)");
+	for(i = 0; i < nfds; ++i)
+		cl += sprintf(&crc[cl], ", `%s`", fds[i].name);
+	cl += sprintf(&crc[cl], ", concat(");
+	for(i = 0; i < nfds; ++i)
+		cl += sprintf(&crc[cl], "%sisnull(`%s`)", (i ? ", " : ""), fds[i].name);
+	sprintf(&crc[cl], ")))");
+	attachfield(mkfield("server", MYSQL_TYPE_STRING), &c->fields);
+	attachfield(mkfield("diff", MYSQL_TYPE_STRING), &c->fields);
+	c->nfields = 2 + mysql_fields(res, &c->fields);
+	mysql_free_result(res);
+	c->sumsql = ecalloc(csz + sizeof c->tbl + 64, 1);
+	sprintf(c->sumsql, "select count(*), coalesce(bit_xor(%s), 0) from %s", crc, c->tbl);
+	c->rowsql = ecalloc(kl + csz + sizeof c->tbl + 64, 1);
+	sprintf(c->rowsql, "select %s, %s, t.* from %s as t", keys, crc, c->tbl);
+	free(keys);
+	free(crc);
+	return comparesplit(c);
 }
 
-Item *
-getitem(int pos) {
-	Item *item;
+void *
+compare_job(void *job) {
+	CompareJob *j = job;
+	Compare *c = j->c;
+	MYSQL_RES *res;
+	MYSQL_ROW row;
+	char *sql;
 	int i;
 
-	if(!selview)
-		return NULL;
-	if(!pos)
-		pos = selview->cur;
-	for(item = selview->items, i = 0; item; item = item->next, ++i)
-		if(i == pos)
+	mysql_thread_init();
+	while(1) {
+		pthread_mutex_lock(&c->lock);
+		i = (*c->err ? c->nchunks : c->next[j->side]++);
+		pthread_mutex_unlock(&c->lock);
+		if(i >= c->nchunks)
 			break;
-	return item;
+		sql = comparequery(c, i, c->sumsql, NULL);
+		if(mysql_query(j->m, sql) || !(res = mysql_store_result(j->m))) {
+			pthread_mutex_lock(&c->lock);
+			if(!*c->err)
+				snprintf(c->err, sizeof c->err, "%s: %s",
+					profiles[c->conn[j->side]].name, mysql_error(j->m));
+			pthread_mutex_unlock(&c->lock);
+			free(sql);
+			break;
+		}
+		if((row = mysql_fetch_row(res))) {
+			c->chunks[i].count[j->side] = strtoull(row[0], NULL, 10);
+			c->chunks[i].sum[j->side] = (row[1] ? strtoull(row[1], NULL, 10) : 0);
+		}
+		mysql_free_result(res);
+		free(sql);
+	}
+	mysql_thread_end();
+	return NULL;
 }
 
-int *
-getmaxlengths(Item *items, Field *fields) {
-	Item *item;
-	Field *fld;
-	int i, *lens, ncols;
+/* Open the connections to profiles a and b the chunks are checksummed on. */
+int
+compareopen(Compare *c, int a, int b) {
+	int i, j;
 
-	if(!(items || fields))
-		return NULL;
-	if(items)
-		ncols = items->ncols;
+	memset(c, 0, sizeof *c);
+	pthread_mutex_init(&c->lock, NULL);
+	c->conn[0] = a;
+	c->conn[1] = b;
+	for(i = 0; i < 2; ++i) {
+		c->m[i] = ecalloc(comparethreads, sizeof(MYSQL *));
+		for(j = 0; j < comparethreads; ++j)
+			if(!(c->m[i][j] = dbopen(c->conn[i], c->err, sizeof c->err)))
+				return -1;
+	}
+	return 0;
+}
+
+/* sql restricted to the rows of a chunk, and to cond if any, to be freed */
+char *
+comparequery(Compare *c, int chunk, const char *sql, const char *cond) {
+	const char *lo = (chunk ? c->bounds[chunk - 1] : NULL);
+	const char *hi = (chunk < c->nbounds ? c->bounds[chunk] : NULL);
+	size_t sz;
+	char *q;
+	int n;
+
+	sz = strlen(sql) + 2 * strlen(c->key) + (lo ? strlen(lo) : 0) + (hi ? strlen(hi) : 0)
+		+ (cond ? strlen(cond) : 0) + 64;
+	q = ecalloc(sz, 1);
+	n = snprintf(q, sz, "%s where ", sql);
+	if(lo && hi)
+		n += snprintf(&q[n], sz - n, "`%s` >= '%s' and `%s` < '%s'", c->key, lo, c->key, hi);
+	else if(lo)
+		n += snprintf(&q[n], sz - n, "`%s` >= '%s'", c->key, lo);
+	else if(hi)
+		n += snprintf(&q[n], sz - n, "(`%s` < '%s' or `%s` is null)", c->key, hi, c->key);
 	else
-		for(fld = fields, ncols = 0; fld; fld = fld->next, ++ncols);
-	lens = ecalloc(ncols, sizeof(int));
-	if(fields)
-		for(fld = fields, i = 0; fld; fld = fld->next, ++i)
-			lens[i] = (fld->len <= MAXCOLSZ ? fld->len : MAXCOLSZ);
-	if(items)
-		for(item = items; item; item = item->next)
-			for(i = 0; i < item->ncols; ++i)
-				if(lens[i] < item->lens[i])
-					lens[i] = (item->lens[i] <= MAXCOLSZ ? item->lens[i] : MAXCOLSZ);
-	return lens;
+		n += snprintf(&q[n], sz - n, "1");
+	if(cond)
+		snprintf(&q[n], sz - n, " and %s", cond);
+	return q;
 }
 
-void
-itempos(const Arg *arg) {
-	int pos;
+/* Add to v the rows of a chunk, within cond if any, which differ between the
+ * two sides, or are only on one of them. Returns how many were added, -1 on
+ * error. */
+int
+comparerange(Compare *c, int chunk, const char *cond, View *v, Item ***tail) {
+	MYSQL_RES *res[2] = {NULL, NULL};
+	MYSQL_ROW row;
+	DiffRow *rows[2] = {NULL, NULL}, *d;
+	unsigned long *lens, *clens = NULL;
+	char *sql, **cols = NULL;
+	int n[2] = {0, 0}, nfds = 0, added = -1, i, j, k, r, side;
 
-	if(!selview || !selview->nitems) {
-		ui_set("info", "No items.");
-		return;
+	sql = comparequery(c, chunk, c->rowsql, cond);
+	for(side = 0; side < 2; ++side) {
+		if(mysql_query(c->m[side][0], sql) || !(res[side] = mysql_store_result(c->m[side][0]))) {
+			snprintf(c->err, sizeof c->err, "%s: %s", profiles[c->conn[side]].name,
+				mysql_error(c->m[side][0]));
+			goto out;
+		}
+		nfds = mysql_num_fields(res[side]);
+		rows[side] = ecalloc(mysql_num_rows(res[side]) + 1, sizeof(DiffRow));
+		while((row = mysql_fetch_row(res[side]))) {
+			lens = mysql_fetch_lengths(res[side]);
+			d = &rows[side][n[side]++];
+			d->key = (row[0] ? row[0] : "");
+			d->sum = (row[1] ? row[1] : "");
+			d->row = row;
+			d->lens = memcpy(ecalloc(nfds, sizeof(unsigned long)), lens,
+				nfds * sizeof(unsigned long));
+		}
+		qsort(rows[side], n[side], sizeof(DiffRow), cmpdiff);
 	}
-	pos = selview->cur + arg->i;
-	if(pos < 0)
-		pos = 0;
-	else if(pos >= selview->nitems)
-		pos = selview->nitems - 1;
-	ui_set("pos", "%d", pos);
-	selview->cur = pos;
-	ui_set("info", "%d of %d item(s)", selview->cur+1, selview->nitems);
+	if(nfds != mysql_num_fields(res[0]) || nfds != c->nfields) {
+		snprintf(c->err, sizeof c->err, "The columns of %s differ.", c->tbl);
+		goto out;
+	}
+	/* the server, what differs and the columns, in place of the key and sum */
+	cols = ecalloc(nfds, sizeof(char *));
+	clens = ecalloc(nfds, sizeof(unsigned long));
+	for(added = i = j = 0; i < n[0] || j < n[1]; i += (r <= 0), j += (r >= 0)) {
+		r = (i == n[0] ? 1 : j == n[1] ? -1 : strcmp(rows[0][i].key, rows[1][j].key));
+		if(!r && !strcmp(rows[0][i].sum, rows[1][j].sum))
+			continue;
+		for(side = 0; side < 2; ++side) {
+			if((side ? r < 0 : r > 0))
+				continue;
+			d = (side ? &rows[1][j] : &rows[0][i]);
+			cols[0] = (char *)profiles[c->conn[side]].name;
+			cols[1] = (r ? "only here" : "differs");
+			clens[0] = strlen(cols[0]);
+			clens[1] = strlen(cols[1]);
+			for(k = 2; k < nfds; ++k) {
+				cols[k] = d->row[k];
+				clens[k] = d->lens[k];
+			}
+			**tail = mkitem(v, cols, clens, nfds);
+			*tail = &(**tail)->next;
+			++added;
+		}
+	}
+out:
+	for(side = 0; side < 2; ++side) {
+		for(i = 0; i < n[side]; ++i)
+			free(rows[side][i].lens);
+		free(rows[side]);
+		if(res[side])
+			mysql_free_result(res[side]);
+	}
+	free(clens);
+	free(cols);
+	free(sql);
+	return added;
 }
 
-void
-mksql_alter_table(char *sql, char *tbl) {
+/* Add to v the rows of a chunk which differ. A chunk of much more than
+ * chunkrows rows, its first key column being skewed or the key composite, is
+ * cut again on the whole key, every chunkrows keys of its larger side, not to
+ * hold it all in memory. Rows whose key has NULLs go where the server's
+ * comparisons with the bounds put them, coalesced to false. */
+int
+comparerows(Compare *c, int chunk, View *v, Item ***tail) {
+	MYSQL *m;
 	MYSQL_RES *res;
 	MYSQL_ROW row;
-	char *p;
-	int size = MAXQUERYLEN, len = 0, r;
+	unsigned long *lens;
+	char **bounds = NULL, *sql, *q, *cond, *p;
+	size_t sz, len;
+	int side = (c->chunks[chunk].count[1] > c->chunks[chunk].count[0]);
+	int nfds, nb = 0, added = 0, n, i, k;
 
-	*sql = '\0';
-	r = mysql_exec("show create table `%s`", tbl);
-	if(r == -1 || !(res = mysql_store_result(mysql)) || !(row = mysql_fetch_row(res)))
-		return;
-	mysql_free_result(res);
-	len += snprintf(&sql[len], size - len + 1, "ALTER TABLE `%s`", tbl);
-	for(r = 0, p = &row[1][0]; row[1][r]; ++r) {
-		if(row[1][r] != '\n')
+	if(c->chunks[chunk].count[side] <= 2 * (unsigned long long)chunkrows)
+		return comparerange(c, chunk, NULL, v, tail);
+	m = c->m[side][0];
+	sz = strlen(c->keys) + sizeof c->tbl + 32;
+	q = ecalloc(sz, 1);
+	snprintf(q, sz, "select %s from %s", c->keys, c->tbl);
+	sql = comparequery(c, chunk, q, NULL);
+	free(q);
+	q = ecalloc(strlen(sql) + sz, 1);
+	sprintf(q, "%s order by %s", sql, c->keys);
+	free(sql);
+	if(mysql_query(m, q) || !(res = mysql_use_result(m))) {
+		snprintf(c->err, sizeof c->err, "%s: %s", profiles[c->conn[side]].name, mysql_error(m));
+		free(q);
+		return -1;
+	}
+	free(q);
+	nfds = mysql_num_fields(res);
+	for(n = 1; (row = mysql_fetch_row(res)); ++n) {
+		if(n % chunkrows)
 			continue;
-		while(*p == ' ')
-			++p;
-		if(*p == '`') {
-			row[1][r] = '\0';
-			len += snprintf(&sql[len], size - len + 1, "\nMODIFY %s", p);
+		lens = mysql_fetch_lengths(res);
+		for(i = 0, len = 8; i < nfds && row[i]; ++i)
+			len += 2 * lens[i] + 4;
+		if(i < nfds)
+			continue; /* NULLs compare to nothing */
+		if(!(nb & (nb + 1)))
+			bounds = realloc(bounds, 2 * (nb + 1) * sizeof(char *));
+		if(!bounds)
+			die("Cannot allocate memory.\n");
+		bounds[nb] = p = ecalloc(len, 1);
+		*p++ = '(';
+		for(i = 0; i < nfds; ++i) {
+			p += sprintf(p, "%s'", (i ? ", " : ""));
+			p += mysql_real_escape_string(m, p, row[i], lens[i]);
+			*p++ = '\'';
 		}
-		p = &row[1][r + 1];
+		*p = ')';
+		++nb;
 	}
-	if(sql[len - 1] == ',')
-		sql[len - 1] = '\0';
+	if(mysql_errno(m)) {
+		snprintf(c->err, sizeof c->err, "%s: %s", profiles[c->conn[side]].name, mysql_error(m));
+		added = -1;
+	}
+	mysql_free_result(res);
+	for(i = 0; added >= 0 && i <= nb; ++i) {
+		sz = 2 * strlen(c->keys) + (i ? strlen(bounds[i - 1]) : 0)
+			+ (i < nb ? strlen(bounds[i]) : 0) + 64;
+		cond = ecalloc(sz, 1);
+		k = 0;
+		if(i)
+			k += snprintf(cond, sz, "coalesce((%s) >= %s, 0)", c->keys, bounds[i - 1]);
+		if(i < nb)
+			snprintf(&cond[k], sz - k, "%snot coalesce((%s) >= %s, 0)",
+				(i ? " and " : ""), c->keys, bounds[i]);
+		if((n = comparerange(c, chunk, (*cond ? cond : NULL), v, tail)) < 0)
+			added = -1;
+		else
+			added += n;
+		free(cond);
+	}
+	for(i = 0; i < nb; ++i)
+		free(bounds[i]);
+	free(bounds);
+	return added;
 }
 
-void
-mksql_update(char *sql, Item *item, Field *fields, char *tbl, char *uk) {
-	Field *fld;
-	char *ukv = NULL, sqlfds[MAXQUERYLEN+1], col[MAXQUERYLEN];
-	int size = MAXQUERYLEN, len = 0, i;
+/* Checksum all the chunks on both sides at once, comparethreads connections
+ * each taking the next chunk of their side until none is left. */
+int
+comparerun(Compare *c) {
+	CompareJob *jobs;
+	int n = 2 * comparethreads, i;
+
+	c->next[0] = c->next[1] = 0;
+	jobs = ecalloc(n, sizeof(CompareJob));
+	for(i = 0; i < n; ++i) {
+		jobs[i] = (CompareJob){.c = c, .side = i % 2, .m = c->m[i % 2][i / 2]};
+		jobs[i].spawned = !pthread_create(&jobs[i].tid, NULL, compare_job, &jobs[i]);
+		if(!jobs[i].spawned)
+			compare_job(&jobs[i]);
+	}
+	for(i = 0; i < n; ++i)
+		if(jobs[i].spawned)
+			pthread_join(jobs[i].tid, NULL);
+	free(jobs);
+	return (*c->err ? -1 : 0);
+}
+
+/* Split the table in chunks of about chunkrows rows on the first column of
+ * its key: evenly between its bounds when it is an integer column, every
+ * chunkrows keys otherwise, only the keys being read. */
+int
+comparesplit(Compare *c) {
+	MYSQL_RES *res;
+	MYSQL_ROW row;
+	unsigned long long count, n, step, i;
+	unsigned long *lens;
+	long long min = 0, max = 0;
+	char buf[32], *end, *p;
+	int r, ints = 0;
+
+	r = mysql_exec("select min(`%s`), max(`%s`), count(*) from %s", c->key, c->key, c->tbl);
+	if(r == -1 || !(res = mysql_store_result(mysql))) {
+		snprintf(c->err, sizeof c->err, "%s", mysql_error(mysql));
+		return -1;
+	}
+	if(!(row = mysql_fetch_row(res))) {
+		mysql_free_result(res);
+		return -1;
+	}
+	count = strtoull(row[2], NULL, 10);
+	n = count / chunkrows + 1;
+	/* digits in a string column do not sort as numbers */
+	if(n > 1 && row[0] && row[1] && IS_NUM(mysql_fetch_fields(res)[0].type)) {
+		min = strtoll(row[0], &end, 10);
+		if(!*end) {
+			max = strtoll(row[1], &end, 10);
+			ints = !*end;
+		}
+	}
+	mysql_free_result(res);
+	c->bounds = ecalloc(n, sizeof(char *));
+	if(n > 1 && ints) {
+		step = ((unsigned long long)max - (unsigned long long)min) / n + 1;
+		for(i = 1; i < n; ++i) {
+			snprintf(buf, sizeof buf, "%lld", (long long)((unsigned long long)min + i * step));
+			c->bounds[c->nbounds++] = strdup(buf);
+		}
+	}
+	else if(n > 1) {
+		r = mysql_exec("select `%s` from %s order by `%s`", c->key, c->tbl, c->key);
+		if(r == -1 || !(res = mysql_use_result(mysql))) {
+			snprintf(c->err, sizeof c->err, "%s", mysql_error(mysql));
+			return -1;
+		}
+		for(i = 1; (row = mysql_fetch_row(res)); ++i) {
+			if(i % chunkrows || !row[0] || c->nbounds == n - 1)
+				continue;
+			lens = mysql_fetch_lengths(res);
+			p = ecalloc(2 * lens[0] + 1, 1);
+			mysql_real_escape_string(mysql, p, row[0], lens[0]);
+			c->bounds[c->nbounds++] = p;
+		}
+		mysql_free_result(res);
+	}
+	c->nchunks = c->nbounds + 1;
+	c->chunks = ecalloc(c->nchunks, sizeof(Chunk));
+	return 0;
+}
+
+/* Stop the copy, keeping the first reason given. */
+void
+copyfail(Copy *c, const char *err) {
+	pthread_mutex_lock(&c->lock);
+	if(!*c->err)
+		snprintf(c->err, sizeof c->err, "%s", err);
+	c->stop = 1;
+	pthread_cond_broadcast(&c->notempty);
+	pthread_cond_broadcast(&c->notfull);
+	pthread_mutex_unlock(&c->lock);
+}
+
+void
+copyfree(Copy *c) {
+	for(; c->count; --c->count, c->head = (c->head + 1) % copyqueue)
+		free(c->queue[c->head].sql);
+	free(c->queue);
+	free(c->sql);
+	if(c->src)
+		mysql_close(c->src);
+	if(c->dst)
+		mysql_close(c->dst);
+	pthread_mutex_destroy(&c->lock);
+	pthread_cond_destroy(&c->notempty);
+	pthread_cond_destroy(&c->notfull);
+	memset(c, 0, sizeof *c);
+}
+
+/* Get ready to copy db.tbl into ddb on profile dconn: create it there unless
+ * it exists and, if it does, resume after the greatest unique key found in
+ * it, all the INSERTs before having been committed. */
+int
+copyinit(Copy *c, int dconn, const char *ddb, const char *db, const char *tbl) {
+	MYSQL_RES *res;
+	MYSQL_ROW row;
+	unsigned long *lens;
+	unsigned long long rows;
+	char kcols[MAXKEYCOLS][4 * MYSQLIDLEN], *sql, *keys, *where, *cols;
+	size_t sz;
+	int nkeys, fullscan, r, i, n;
+
+	memset(c, 0, sizeof *c);
+	pthread_mutex_init(&c->lock, NULL);
+	pthread_cond_init(&c->notempty, NULL);
+	pthread_cond_init(&c->notfull, NULL);
+	c->conn = curconn;
+	c->queue = ecalloc(copyqueue, sizeof(Batch));
+	snprintf(c->from, sizeof c->from, "`%s`.`%s`", db, tbl);
+	snprintf(c->to, sizeof c->to, "`%s`.`%s`", ddb, tbl);
+	if(!(c->src = dbopen(c->conn, c->err, sizeof c->err))
+	|| !(c->dst = dbopen(dconn, c->err, sizeof c->err)))
+		return -1;
+
+	/* the table, as it is */
+	r = mysql_exec("show create table %s", c->from);
+	if(r == -1 || !(res = mysql_store_result(mysql))) {
+		snprintf(c->err, sizeof c->err, "%s", mysql_error(mysql));
+		return -1;
+	}
+	if(!(row = mysql_fetch_row(res)) || mysql_num_fields(res) != 2
+	|| strncasecmp(row[1], "CREATE TABLE ", 13)) {
+		mysql_free_result(res);
+		snprintf(c->err, sizeof c->err, "Not a base table.");
+		return -1;
+	}
+	sz = strlen(row[1]) + 32;
+	sql = ecalloc(sz, 1);
+	n = snprintf(sql, sz, "CREATE TABLE IF NOT EXISTS %s", &row[1][13]);
+	mysql_free_result(res);
+	r = (mysql_select_db(c->dst, ddb) || mysql_real_query(c->dst, sql, n));
+	free(sql);
+	if(r) {
+		snprintf(c->err, sizeof c->err, "%s", mysql_error(c->dst));
+		return -1;
+	}
+
+	/* where to resume from */
+	if((nkeys = mysql_ukeys(c->from, kcols, MAXKEYCOLS)) < 0) {
+		snprintf(c->err, sizeof c->err, "%s", mysql_error(mysql));
+		return -1;
+	}
+	keys = ecalloc(nkeys + 1, sizeof kcols[0] + 8);
+	sql = ecalloc(nkeys + 1, 2 * sizeof kcols[0] + 16);
+	for(i = n = 0; i < nkeys; ++i)
+		n += sprintf(&keys[n], "%s`%s`", (i ? ", " : ""), kcols[i]);
+	n = sprintf(sql, "select %s from %s", (nkeys ? keys : "1"), c->to);
+	for(i = 0; i < nkeys; ++i)
+		n += sprintf(&sql[n], "%s`%s` desc", (i ? ", " : " order by "), kcols[i]);
+	sprintf(&sql[n], " limit 1");
+	r = mysql_query(c->dst, sql);
+	free(sql);
+	if(r || !(res = mysql_store_result(c->dst))) {
+		snprintf(c->err, sizeof c->err, "%s", mysql_error(c->dst));
+		free(keys);
+		return -1;
+	}
+	where = NULL;
+	if((row = mysql_fetch_row(res))) {
+		lens = mysql_fetch_lengths(res);
+		for(i = 0, sz = 64 + strlen(keys); i < nkeys; ++i)
+			sz += 2 * lens[i] + 4;
+		where = ecalloc(sz, 1);
+		n = sprintf(where, " where (%s) > (", keys);
+		for(i = 0; i < nkeys && row[i]; ++i) {
+			n += sprintf(&where[n], "%s'", (i ? ", " : ""));
+			n += mysql_real_escape_string(c->src, &where[n], row[i], lens[i]);
+			n += sprintf(&where[n], "'");
+		}
+		sprintf(&where[n], ")");
+		if(!nkeys || i < nkeys)
+			snprintf(c->err, sizeof c->err, (nkeys ? "Cannot resume after a NULL key."
+				: "No unique key to resume from, the copy is not empty."));
+	}
+	mysql_free_result(res);
+	if(*c->err) {
+		free(where);
+		free(keys);
+		return -1;
+	}
+
+	/* the columns, less the generated ones the server would not take */
+	r = mysql_exec("show columns from %s", c->from);
+	if(r == -1 || !(res = mysql_store_result(mysql))) {
+		snprintf(c->err, sizeof c->err, "%s", mysql_error(mysql));
+		free(where);
+		free(keys);
+		return -1;
+	}
+	cols = ecalloc(mysql_num_rows(res) + 1, sizeof kcols[0] + 4);
+	for(n = 0; (row = mysql_fetch_row(res));) {
+		if(mysql_num_fields(res) > 5 && row[5] && (strstr(row[5], "VIRTUAL")
+		|| strstr(row[5], "STORED") || strstr(row[5], "PERSISTENT")))
+			continue;
+		n += sprintf(&cols[n], "%s`%s`", (n ? ", " : ""), row[0]);
+	}
+	mysql_free_result(res);
+	sz = strlen(cols) + strlen(c->from) + strlen(keys) + (where ? strlen(where) : 0) + 64;
+	c->sql = ecalloc(sz, 1);
+	snprintf(c->sql, sz, "select %s from %s%s%s%s", cols, c->from, (where ? where : ""),
+		(nkeys ? " order by " : ""), keys);
+	free(cols);
+	free(where);
+	free(keys);
+	if(!mysql_explain(c->sql, &rows, &fullscan))
+		c->total = rows;
+	return 0;
+}
+
+/* Follow the copy in the status bar and clean up once it is over. */
+void
+copypoll(void) {
+	unsigned long long rows;
+	size_t bytes;
+	char sz[32], eta[32] = "?", kill[64];
+	double t, rate;
+	int finished, stop, i;
+
+	if(!copy.state)
+		return;
+	pthread_mutex_lock(&copy.lock);
+	finished = copy.finished;
+	stop = copy.stop;
+	rows = copy.rows;
+	bytes = copy.bytes;
+	pthread_mutex_unlock(&copy.lock);
+	if(stop && !copy.killed && copy.spawned[0]) {
+		/* the reader would otherwise read what is left of the table before
+		 * letting go of its result */
+		snprintf(kill, sizeof kill, "kill query %lu", mysql_thread_id(copy.src));
+		mysql_query(conns[copy.conn], kill);
+		copy.killed = 1;
+	}
+	t = now() - copy.start;
+	rate = (t > 0 ? rows / t : 0);
+	fmtbytes(sz, sizeof sz, bytes);
+	if(finished < 2) {
+		if(rate > 0 && copy.total > rows) {
+			i = (copy.total - rows) / rate;
+			snprintf(eta, sizeof eta, "%d:%02d:%02d", i / 3600, i / 60 % 60, i % 60);
+		}
+		ui_set("status", "Copying %s: %llu row(s), %s, %.0f rows/s, ETA %s",
+			copy.from, rows, sz, rate, eta);
+		return;
+	}
+	for(i = 0; i < 2; ++i)
+		if(copy.spawned[i])
+			pthread_join(copy.tid[i], NULL);
+	if(*copy.err)
+		ui_set("status", "Copy of %s stopped after %llu row(s): %s", copy.from, rows, copy.err);
+	else
+		ui_set("status", "Copied %llu row(s), %s of %s in %.1fs, %.0f rows/s",
+			rows, sz, copy.from, t, rate);
+	copyfree(&copy);
+}
+
+/* Queue a batch for the writer, waiting for room. Returns -1 if the copy
+ * was stopped meanwhile, the batch being dropped. */
+int
+copypush(Copy *c, Batch *b) {
+	pthread_mutex_lock(&c->lock);
+	while(c->count == copyqueue && !c->stop)
+		pthread_cond_wait(&c->notfull, &c->lock);
+	if(c->stop) {
+		pthread_mutex_unlock(&c->lock);
+		free(b->sql);
+		b->sql = NULL;
+		return -1;
+	}
+	c->queue[(c->head + c->count++) % copyqueue] = *b;
+	pthread_cond_signal(&c->notempty);
+	pthread_mutex_unlock(&c->lock);
+	return 0;
+}
+
+/* Stream the rows of the table into batches of multi-row INSERTs of about
+ * copybatch bytes. Binary strings are sent in hexadecimal. */
+void *
+copy_reader(void *arg) {
+	Copy *c = arg;
+	MYSQL_RES *res;
+	MYSQL_ROW row;
+	MYSQL_FIELD *fds;
+	Batch b = {NULL, 0, 0};
+	unsigned long *lens;
+	size_t sz = 0, hdr, need;
+	int nfds, hex, i, j;
+
+	mysql_thread_init();
+	if(mysql_query(c->src, c->sql) || !(res = mysql_use_result(c->src))) {
+		copyfail(c, mysql_error(c->src));
+		goto out;
+	}
+	nfds = mysql_num_fields(res);
+	fds = mysql_fetch_fields(res);
+	for(i = 0, hdr = strlen(c->to) + 32; i < nfds; ++i)
+		hdr += fds[i].name_length + 8;
+	while((row = mysql_fetch_row(res))) {
+		lens = mysql_fetch_lengths(res);
+		need = (b.len ? 0 : hdr);
+		for(i = 0; i < nfds; ++i)
+			need += 2 * lens[i] + 8;
+		if(b.len + need > sz) {
+			sz = (b.len + need) * 2;
+			if(!(b.sql = realloc(b.sql, sz)))
+				die("Cannot allocate memory.\n");
+		}
+		if(!b.len) {
+			b.len = sprintf(b.sql, "insert into %s (", c->to);
+			for(i = 0; i < nfds; ++i)
+				b.len += sprintf(&b.sql[b.len], "%s`%s`", (i ? ", " : ""), fds[i].name);
+			b.len += sprintf(&b.sql[b.len], ") values");
+		}
+		b.sql[b.len++] = (b.nrows ? ',' : ' ');
+		b.sql[b.len++] = '(';
+		for(i = 0; i < nfds; ++i) {
+			if(i)
+				b.sql[b.len++] = ',';
+			hex = (fds[i].charsetnr == 63 && (fds[i].type == MYSQL_TYPE_BIT
+				|| fds[i].type == MYSQL_TYPE_VARCHAR
+				|| (fds[i].type >= MYSQL_TYPE_TINY_BLOB && fds[i].type <= MYSQL_TYPE_GEOMETRY)));
+			if(!row[i])
+				b.len += sprintf(&b.sql[b.len], "NULL");
+			else if(hex && lens[i]) {
+				b.len += sprintf(&b.sql[b.len], "0x");
+				for(j = 0; j < lens[i]; ++j)
+					b.len += sprintf(&b.sql[b.len], "%02x", (unsigned char)row[i][j]);
+			}
+			else {
+				b.sql[b.len++] = '\'';
+				b.len += mysql_real_escape_string(c->src, &b.sql[b.len], row[i], lens[i]);
+				b.sql[b.len++] = '\'';
+			}
+		}
+		b.sql[b.len++] = ')';
+		b.sql[b.len] = '\0';
+		++b.nrows;
+		if(b.len >= copybatch) {
+			if(copypush(c, &b))
+				break;
+			memset(&b, 0, sizeof b);
+			sz = 0;
+		}
+	}
+	if(!row && mysql_errno(c->src))
+		copyfail(c, mysql_error(c->src));
+	if(b.nrows && !row)
+		copypush(c, &b);
+	else
+		free(b.sql);
+	mysql_free_result(res);
+out:
+	pthread_mutex_lock(&c->lock);
+	c->eof = 1;
+	++c->finished;
+	pthread_cond_broadcast(&c->notempty);
+	pthread_mutex_unlock(&c->lock);
+	mysql_thread_end();
+	return NULL;
+}
+
+/* Copy the selected table to a database of any server, or stop the copy
+ * going on. */
+void
+copytable(const Arg *arg) {
+	char dest[MYSQLIDLEN*2+2] = "", *db, *ddb;
+	int dconn, i;
+
+	if(copy.state) {
+		if(ui_ask("Stop the copy going on (y/[n])?", "ny") != 'y')
+			return;
+		copyfail(&copy, "stopped");
+		return;
+	}
+	if(!getitem(0)) {
+		ui_set("status", "No table selected.");
+		return;
+	}
+	db = ITEMCOL(selview->choice, 0);
+	snprintf(dest, sizeof dest, "%s:%s",
+		profiles[(LENGTH(profiles) == 2 ? !selview->conn : selview->conn)].name, db);
+	if(ui_input("Copy to (server:database): ", dest, sizeof dest, 0, NULL) <= 0)
+		return;
+	if((ddb = strchr(dest, ':'))) {
+		*ddb++ = '\0';
+		for(dconn = 0; dconn < LENGTH(profiles) && strcmp(profiles[dconn].name, dest); ++dconn);
+		if(dconn == LENGTH(profiles)) {
+			ui_set("status", "No such server: %s.", dest);
+			return;
+		}
+	}
+	else {
+		ddb = dest;
+		dconn = selview->conn;
+	}
+	if(dconn == selview->conn && !strcmp(ddb, db)) {
+		ui_set("status", "Cannot copy a table onto itself.");
+		return;
+	}
+	if(copyinit(&copy, dconn, ddb, db, ITEMCOL(getitem(0), 0))) {
+		ui_set("status", "Cannot copy %s: %s", copy.from, copy.err);
+		copyfree(&copy);
+		return;
+	}
+	copy.start = now();
+	copy.state = 1;
+	copy.spawned[0] = !pthread_create(&copy.tid[0], NULL, copy_reader, &copy);
+	copy.spawned[1] = copy.spawned[0]
+		&& !pthread_create(&copy.tid[1], NULL, copy_writer, &copy);
+	for(i = 0; i < 2; ++i) {
+		if(copy.spawned[i])
+			continue;
+		/* both are needed at once, the queue being bounded */
+		copyfail(&copy, "Cannot start a thread.");
+		pthread_mutex_lock(&copy.lock);
+		++copy.finished;
+		pthread_mutex_unlock(&copy.lock);
+	}
+	copypoll();
+}
+
+/* Run the batches queued by the reader, each being committed on its own. */
+void *
+copy_writer(void *arg) {
+	Copy *c = arg;
+	Batch b;
+
+	mysql_thread_init();
+	while(1) {
+		pthread_mutex_lock(&c->lock);
+		while(!c->count && !c->eof && !c->stop)
+			pthread_cond_wait(&c->notempty, &c->lock);
+		if(c->stop || !c->count) {
+			pthread_mutex_unlock(&c->lock);
+			break;
+		}
+		b = c->queue[c->head];
+		c->head = (c->head + 1) % copyqueue;
+		--c->count;
+		pthread_cond_signal(&c->notfull);
+		pthread_mutex_unlock(&c->lock);
+		if(mysql_real_query(c->dst, b.sql, b.len)) {
+			copyfail(c, mysql_error(c->dst));
+			free(b.sql);
+			break;
+		}
+		pthread_mutex_lock(&c->lock);
+		c->rows += b.nrows;
+		c->bytes += b.len;
+		pthread_mutex_unlock(&c->lock);
+		free(b.sql);
+	}
+	pthread_mutex_lock(&c->lock);
+	++c->finished;
+	pthread_mutex_unlock(&c->lock);
+	mysql_thread_end();
+	return NULL;
+}
+
+/* Connect to a profile, once. Safe to call from any thread as long as each
+ * profile is connected by one thread at a time. */
+MYSQL *
+dbconnect(int conn, char *err, int sz) {
+	if(conns[conn])
+		return conns[conn];
+	return conns[conn] = dbopen(conn, err, sz);
+}
+
+/* Open a new connection to a profile. */
+MYSQL *
+dbopen(int conn, char *err, int sz) {
+	MYSQL *m;
+
+	if(!(m = mysql_init(NULL))) {
+		snprintf(err, sz, "Cannot allocate memory.");
+		return NULL;
+	}
+	if(!mysql_real_connect(m, profiles[conn].host, profiles[conn].user,
+			profiles[conn].pass, NULL, 0, NULL, 0)) {
+		snprintf(err, sz, "%s", mysql_error(m));
+		mysql_close(m);
+		return NULL;
+	}
+	return m;
+}
+
+void
+detach(View *v) {
+	View **tv;
+
+	for(tv = &views; *tv && *tv != v; tv = &(*tv)->next);
+	*tv = v->next;
+}
+
+void
+detachfield(Field *f, Field **ff) {
+	Field **tf;
+
+	for(tf = &(*ff); *tf && *tf != f; tf = &(*tf)->next);
+	*tf = f->next;
+}
+
+void
+detachitem(Item *i, Item **ii) {
+	Item **ti;
+
+	for(ti = &(*ii); *ti && *ti != i; ti = &(*ti)->next);
+	*ti = i->next;
+}
+
+void
+die(const char *errstr, ...) {
+	va_list ap;
+
+	va_start(ap, errstr);
+	vfprintf(stderr, errstr, ap);
+	va_end(ap);
+	exit(1);
+}
+
+void *
+ecalloc(size_t nmemb, size_t size) {
+	void *p;
+
+	if (!(p = calloc(nmemb, size)))
+		die("Cannot allocate memory.\n");
+	return p;
+}
+
+void
+editfile(char *file) {
+        pid_t pid;
+	int rc = -1;
+	struct sigaction saold[4];
+
+	/* take off ncurses signal handlers */
+	struct sigaction sa = {.sa_flags = 0, .sa_handler = SIG_DFL};
+	sigaction(SIGINT, &sa, &saold[0]);
+	sigaction(SIGTERM, &sa, &saold[1]);
+	sigaction(SIGTSTP, &sa, &saold[2]);
+	sigaction(SIGWINCH, &sa, &saold[3]);
+
+        if((pid = fork()) == 0) {
+                execl("/bin/sh", "sh", "-c", "$EDITOR \"$0\"", file, NULL);
+                _exit(127);
+        }
+	else if(pid == -1)
+		return;
+	while(!WIFEXITED(rc))
+		waitpid(pid, &rc, 0);
+
+	/* restore ncurses signal handlers */
+	sigaction(SIGINT, &saold[0], NULL);
+	sigaction(SIGTERM, &saold[1], NULL);
+	sigaction(SIGTSTP, &saold[2], NULL);
+	sigaction(SIGWINCH, &saold[3], NULL);
+
+	/* reinitialize ncurses */
+	endwin();
+	refresh();
+}
+
+void
+editrecord(const Arg *arg) {
+	Item *item = getitem(0);
+	char *tbl = ITEMCOL(selview->choice, 0), uk[MYSQLIDLEN+1], sql[MAXQUERYLEN+1];
+
+	if(!item) {
+		ui_set("status", "No item selected.");
+		return;
+	}
+	if(mysql_ukey(uk, tbl, sizeof uk)) {
+		ui_set("status", "Cannot edit records in `%s`, no unique key found.", tbl);
+		return;
+	}
+	mksql_update(sql, item, selview->fields, tbl, uk);
+	ui_sql_edit_exec(sql);
+}
+
+void
+edittable(const Arg *arg) {
+	Item *item = getitem(0);
+	char sql[MAXQUERYLEN+1];
+
+	if(!item) {
+		ui_set("status", "No table selected.");
+		return;
+	}
+	/* XXX check alter table permissions */
+	mksql_alter_table(sql, ITEMCOL(item, 0));
+	ui_sql_edit_exec(sql);
+}
+
+/* Drop the items and the form of a view not being shown, it is reloaded
+ * through its show() when selected again. */
+void
+evict(View *v) {
+	cleanuprows(v);
+	cleanupitems(&v->items);
+	cleanupspill(v);
+	free(v->lens);
+	v->lens = NULL;
+	v->nitems = 0;
+	if(v->form)
+		stfl_free(v->form);
+	v->form = NULL;
+	v->evicted = 1;
+}
+
+int
+escape(char *esc, char *s, int sz, char c, char skip) {
+	int i, ei = 0;
+
+	for(i = 0; i < sz; ++i) {
+		if(s[i] == c && (!skip || s[i+1] != skip))
+			esc[ei++] = '\\';
+		esc[ei++] = s[i];
+	}
+	esc[ei] = '\0';
+	return ei - sz;
+}
+
+void
+filterrows(View *v, const char *pat) {
+	char fp[MAXPATLEN];
+	const char *p, *q, *end;
+	char *hit;
+	size_t m;
+	int i, n;
+
+	for(m = 0; pat[m] && m < sizeof fp - 1; ++m)
+		fp[m] = tolower((unsigned char)pat[m]);
+	fp[m] = '\0';
+	if(!m) {
+		memcpy(v->rows, v->order, v->nitems * sizeof(int));
+		v->nrows = v->nitems;
+	}
+	else if(*v->filter && !strncmp(fp, v->filter, strlen(v->filter))) {
+		/* the pattern only grew: narrow the rows already listed */
+		for(i = n = 0; i < v->nrows; ++i)
+			if(rowmatch(v, v->rows[i], fp, m))
+				v->rows[n++] = v->rows[i];
+		v->nrows = n;
+	}
+	else {
+		if(!v->sbuf)
+			searchbuf(v);
+		hit = rowalloc(v, v->nitems, 1);
+		end = v->sbuf + v->soff[v->nitems];
+		for(p = v->sbuf, i = 0; (q = memfind(p, end - p, fp, m)); p = v->sbuf + v->soff[++i]) {
+			while(v->soff[i + 1] <= (size_t)(q - v->sbuf))
+				++i;
+			hit[i] = 1;
+		}
+		for(i = n = 0; i < v->nitems; ++i)
+			if(hit[v->order[i]])
+				v->rows[n++] = v->order[i];
+		v->nrows = n;
+		rowfree(hit);
+	}
+	memcpy(v->filter, fp, m + 1);
+}
+
+void
+filtertable(const Arg *arg) {
+	char clause[sizeof selview->where], cond[sizeof selview->where], sql[MAXQUERYLEN+1];
+	char msg[256];
+	unsigned long long rows;
+	int fullscan;
+
+	snprintf(clause, sizeof clause, "%s", selview->where);
+	if(ui_input("Filter (WHERE/ORDER BY/LIMIT or column=value): ",
+			clause, sizeof clause, 0, NULL) < 0)
+		return;
+	mksql_where(cond, sizeof cond, clause, selview->fields);
+	if(*cond) {
+		snprintf(sql, sizeof sql, "select * from `%s` %s",
+			ITEMCOL(selview->choice, 0), cond);
+		if(mysql_explain(sql, &rows, &fullscan)) {
+			ui_set("status", "%s", mysql_error(mysql));
+			return;
+		}
+		snprintf(msg, sizeof msg, "About %llu row(s)%s. Run ([y]/n)?", rows,
+			(fullscan ? ", no index can be used (full scan)" : ""));
+		if(ui_ask(msg, "yn") != 'y')
+			return;
+	}
+	memcpy(selview->where, cond, sizeof selview->where);
+	selview->cur = selview->top = 0;
+	reload(NULL);
+}
+
+void
+fanout(const Arg *arg) {
+	static char sql[MAXQUERYLEN+1];
+
+	if(ui_input("Query on all servers: ", sql, sizeof sql, 1, NULL) <= 0)
+		return;
+	histadd(sql);
+	histsave();
+	setview("fanout", NULL);
+	selview->query = strdup(sql);
+	selview->show = viewfanout_show;
+	reload(NULL);
+}
+
+void *
+fanout_job(void *job) {
+	FanJob *j = job;
+	MYSQL *m;
+
+	mysql_thread_init();
+	if((m = dbconnect(j->conn, j->err, sizeof j->err))) {
+		if(mysql_real_query(m, j->sql, strlen(j->sql)))
+			snprintf(j->err, sizeof j->err, "%s", mysql_error(m));
+		else if(!(j->res = mysql_store_result(m)))
+			snprintf(j->err, sizeof j->err, "%s", (mysql_field_count(m)
+				? mysql_error(m) : "No result set."));
+	}
+	mysql_thread_end();
+	return NULL;
+}
+
+void
+fmtbytes(char *buf, int sz, size_t n) {
+	const char *units = "KMGT";
+	double d = n;
+	int u = -1;
+
+	while(d >= 1024 && units[u + 1]) {
+		d /= 1024;
+		++u;
+	}
+	if(u < 0)
+		snprintf(buf, sz, "%zuB", n);
+	else
+		snprintf(buf, sz, "%.1f%c", d, units[u]);
+}
+
+/* Make room for n more wide characters in the frame. */
+void
+framegrow(size_t n) {
+	if(framelen + n + 1 <= framesz)
+		return;
+	framesz = (framelen + n + 1) * 2;
+	if(!(frame = realloc(frame, framesz * sizeof(wchar_t))))
+		die("Cannot allocate memory.\n");
+}
+
+/* Append s[0..len) to the frame, escaped for a double quoted STFL value and,
+ * if rich, for rich text where '<' opens a style tag. */
+void
+frameputs(const char *s, int len, int rich) {
+	mbstate_t ps;
+	wchar_t wc, *w;
+	size_t n;
+	int i;
+
+	framegrow(5 * len); /* '"' is the longest to escape */
+	w = &frame[framelen];
+	memset(&ps, 0, sizeof ps);
+	for(i = 0; i < len; i += n) {
+		n = mbrtowc(&wc, &s[i], len - i, &ps);
+		if(n == (size_t)-1 || n == (size_t)-2) {
+			memset(&ps, 0, sizeof ps);
+			wc = L'?';
+			n = 1;
+		}
+		else if(!n)
+			break;
+		if(wc == L'"')
+			w = wmemcpy(w, L"\"'\"'\"", 5) + 5;
+		else if(rich && wc == L'<')
+			w = wmemcpy(w, L"<>", 2) + 2;
+		else
+			*w++ = wc;
+	}
+	*w = L'\0';
+	framelen = w - frame;
+}
+
+void
+framewcs(const wchar_t *ws) {
+	size_t n = wcslen(ws);
+
+	framegrow(n);
+	wmemcpy(&frame[framelen], ws, n + 1);
+	framelen += n;
+}
+
+int
+findrow(const char *pat, int from, int dir) {
+	char fp[MAXPATLEN];
+	size_t m;
+	int i, n;
+
+	if(!(selview && selview->nrows))
+		return -1;
+	for(m = 0; pat[m] && m < sizeof fp - 1; ++m)
+		fp[m] = tolower((unsigned char)pat[m]);
+	if(!m)
+		return -1;
+	if(!selview->sbuf)
+		searchbuf(selview);
+	for(n = 0, i = from; n < selview->nrows; ++n, i += dir) {
+		if(i < 0)
+			i = selview->nrows - 1;
+		else if(i >= selview->nrows)
+			i = 0;
+		if(rowmatch(selview, selview->rows[i], fp, m))
+			return i;
+	}
+	return -1;
+}
+
+/* The item listed at pos, the selected one if 0. A spilled row is pointed
+ * to by the same item each time, valid until the next call. */
+Item *
+getitem(int pos) {
+	static Item item;
+
+	if(!(selview && selview->nrows))
+		return NULL;
+	if(!pos)
+		pos = selview->cur;
+	if(pos < 0 || pos >= selview->nrows)
+		return NULL;
+	return rowitem(selview, selview->rows[pos], &item);
+}
+
+/* Keep the memory held by all views within viewbudget, evicting the least
+ * recently shown views first. */
+void
+govern(void) {
+	View *v, *lru;
+	size_t total;
+
+	if(!viewbudget)
+		return;
+	while(1) {
+		for(total = 0, lru = NULL, v = views; v; v = v->next) {
+			total += viewbytes(v);
+			/* views without show(), like the outcome of a statement
+			 * returning no rows, cannot be rebuilt */
+			if(v != selview && !v->evicted && v->show
+			&& (!lru || v->used < lru->used))
+				lru = v;
+		}
+		if(total <= viewbudget || !lru)
+			break;
+		evict(lru);
+	}
+}
+
+/* The SQL history is a ring of the last HISTSIZE queries run, kept in the
+ * cache directory one per line with newlines and backslashes escaped. */
+void
+histadd(const char *sql) {
+	char *s;
+
+	if(!*sql || (histlen && !strcmp(histget(0), sql)))
+		return;
+	if(!(s = strdup(sql)))
+		die("Cannot allocate memory.\n");
+	if(histlen < HISTSIZE)
+		history[(histhead + histlen++) % HISTSIZE] = s;
+	else {
+		free(history[histhead]);
+		history[histhead] = s;
+		histhead = (histhead + 1) % HISTSIZE;
+	}
+}
+
+/* The nth newest query of the history. */
+const char *
+histget(int n) {
+	return history[(histhead + histlen - 1 - n) % HISTSIZE];
+}
+
+void
+histload(void) {
+	char path[PATH_MAX], *line = NULL, *r, *w;
+	size_t sz = 0;
+	ssize_t len;
+	FILE *fp;
+
+	cachepath("history", path, sizeof path);
+	if(!(fp = fopen(path, "r")))
+		return;
+	while((len = getline(&line, &sz, fp)) != -1) {
+		if(len && line[len - 1] == '\n')
+			line[len - 1] = '\0';
+		for(r = w = line; *r; ++r, ++w)
+			*w = (*r == '\\' && r[1] ? (*++r == 'n' ? '\n' : *r) : *r);
+		*w = '\0';
+		histadd(line);
+	}
+	free(line);
+	fclose(fp);
+}
+
+void
+histsave(void) {
+	char path[PATH_MAX], tmp[PATH_MAX+16];
+	const char *p;
+	FILE *fp;
+	int i, r = 0;
+
+	cachepath("history", path, sizeof path);
+	cachedirs(path);
+	snprintf(tmp, sizeof tmp, "%s.%d", path, (int)getpid());
+	if(!(fp = fopen(tmp, "w")))
+		return;
+	for(i = histlen - 1; i >= 0; --i) {
+		for(p = histget(i); *p; ++p) {
+			if(*p == '\n')
+				r |= fputs("\\n", fp) == EOF;
+			else if(*p == '\\')
+				r |= fputs("\\\\", fp) == EOF;
+			else
+				r |= fputc(*p, fp) == EOF;
+		}
+		r |= fputc('\n', fp) == EOF;
+	}
+	r |= fclose(fp);
+	if(r || rename(tmp, path))
+		unlink(tmp);
+}
+
+int *
+getmaxlengths(Item *items, Field *fields) {
+	Item *item;
+	Field *fld;
+	int i, *lens, ncols;
+
+	if(!(items || fields))
+		return NULL;
+	if(items)
+		ncols = items->ncols;
+	else
+		for(fld = fields, ncols = 0; fld; fld = fld->next, ++ncols);
+	lens = ecalloc(ncols, sizeof(int));
+	if(fields)
+		for(fld = fields, i = 0; fld; fld = fld->next, ++i)
+			lens[i] = (fld->width <= MAXCOLSZ ? fld->width : MAXCOLSZ);
+	if(items)
+		for(item = items; item; item = item->next)
+			for(i = 0; i < item->ncols; ++i)
+				if(lens[i] < ITEMWIDTH(item, i))
+					lens[i] = (ITEMWIDTH(item, i) <= MAXCOLSZ ? ITEMWIDTH(item, i) : MAXCOLSZ);
+	return lens;
+}
+
+/* Tell whether s[0..len) is made of printable ASCII only, in which case
+ * bytes and display columns are the same thing. Bytes below the space and
+ * above 0x7f are both negative or less than 0x20 as signed chars. */
+int
+isprintascii(const char *s, int len) {
+	int i = 0;
+
+#if defined __AVX2__
+	for(; i + 32 <= len; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)&s[i]);
+
+		if(_mm256_movemask_epi8(_mm256_or_si256(
+				_mm256_cmpgt_epi8(_mm256_set1_epi8(' '), v),
+				_mm256_cmpeq_epi8(_mm256_set1_epi8(0x7f), v))))
+			return 0;
+	}
+#elif defined __SSE2__
+	for(; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)&s[i]);
+
+		if(_mm_movemask_epi8(_mm_or_si128(
+				_mm_cmplt_epi8(v, _mm_set1_epi8(' ')),
+				_mm_cmpeq_epi8(v, _mm_set1_epi8(0x7f)))))
+			return 0;
+	}
+#endif
+	for(; i < len; ++i)
+		if((unsigned char)s[i] < ' ' || (unsigned char)s[i] >= 0x7f)
+			return 0;
+	return 1;
+}
+
+Item *
+itemdup(Item *item) {
+	Item *dup;
+	size_t sz;
+
+	if(!item)
+		return NULL;
+	sz = itemsize(item);
+	dup = ecalloc(1, sizeof(Item) + sz);
+	dup->data = (char *)&dup[1];
+	dup->ncols = item->ncols;
+	memcpy(dup->data, item->data, sz);
+	return dup;
+}
+
+/* Add transaction i of t to v, followed by the ones it blocks, indented. */
+void
+lockadd(View *v, LockTrx *t, int n, int i, int depth, int root, Item ***tail) {
+	char trx[MAXCOLSZ * 4 + 32], waiters[16], *cols[12];
+	unsigned long lens[LENGTH(cols)];
+	int j;
+
+	t[i].done = 1;
+	snprintf(trx, sizeof trx, "%*s%s%s", 2 * depth, "", (depth ? "`- " : ""), t[i].row[0]);
+	snprintf(waiters, sizeof waiters, "%d", t[i].nwait);
+	cols[0] = trx;
+	cols[1] = t[i].row[2];
+	cols[2] = t[root].row[2];
+	cols[3] = waiters;
+	for(j = 4; j < LENGTH(cols); ++j)
+		cols[j] = t[i].row[j - 1];
+	for(j = 0; j < LENGTH(cols); ++j)
+		lens[j] = (!cols[j] ? 0 : j >= 4 ? t[i].lens[j - 1] : strlen(cols[j]));
+	**tail = mkitem(v, cols, lens, LENGTH(cols));
+	*tail = &(**tail)->next;
+	++v->nitems;
+	for(j = 0; j < n; ++j)
+		if(t[j].parent == i && !t[j].done)
+			lockadd(v, t, n, j, depth + 1, root, tail);
+}
+
+/* Fill v with the InnoDB transactions of res as trees of who blocks whom,
+ * the blockers holding up the most first, then the others from the oldest.
+ * A transaction waiting on several others is shown under the first of them.
+ * Without res, v gets err as its only row. */
+void
+lockstree(View *v, MYSQL_RES *res, const char *err) {
+	const char *fds[] = { "trx", "thread", "root", "waiters", "user", "host", "db",
+		"state", "age", "rows locked", "undo rows", "query" };
+	MYSQL_ROW row;
+	LockTrx *t;
+	Item **tail;
+	char *col;
+	unsigned long len;
+	int n = 0, pass, i, j, k;
+
+	cleanuprows(v);
+	cleanupitems(&v->items);
+	cleanupspill(v);
+	cleanupfields(&v->fields);
+	if(!res) {
+		/* refreshed on its own, an error must not end the session */
+		attachfield(mkfield("error", MYSQL_TYPE_STRING), &v->fields);
+		col = (char *)err;
+		len = strlen(col);
+		v->nfields = 1;
+		v->items = mkitem(v, &col, &len, 1);
+		v->nitems = 1;
+		goto show;
+	}
+	for(i = 0; i < LENGTH(fds); ++i)
+		attachfield(mkfield(fds[i], (i >= 1 && i <= 3) || (i >= 8 && i <= 10)
+			? MYSQL_TYPE_LONGLONG : MYSQL_TYPE_STRING), &v->fields);
+	v->nfields = LENGTH(fds);
+	t = ecalloc(mysql_num_rows(res) + 1, sizeof(LockTrx));
+	while((row = mysql_fetch_row(res))) {
+		t[n].row = row;
+		t[n].lens = memcpy(ecalloc(mysql_num_fields(res), sizeof(unsigned long)),
+			mysql_fetch_lengths(res), mysql_num_fields(res) * sizeof(unsigned long));
+		t[n++].parent = -1;
+	}
+	for(i = 0; i < n; ++i)
+		for(j = 0; t[i].row[1] && j < n; ++j)
+			if(j != i && !strcmp(t[j].row[0], t[i].row[1]))
+				t[i].parent = j;
+	/* count the transactions held up behind each, cycles included */
+	for(i = 0; i < n; ++i)
+		for(j = t[i].parent, k = 0; j != -1 && k < n; j = t[j].parent, ++k)
+			++t[j].nwait;
+	v->nitems = 0;
+	tail = &v->items;
+	for(pass = 0; pass < 3; ++pass) {
+		while(1) {
+			/* roots blocking others by most held up, then the rest;
+			 * deadlocked ones, having no root, last */
+			for(i = 0, k = -1; i < n; ++i)
+				if(!t[i].done && (pass == 2 || (t[i].parent == -1 && !pass == !!t[i].nwait))
+				&& (k == -1 || t[i].nwait > t[k].nwait))
+					k = i;
+			if(k == -1)
+				break;
+			lockadd(v, t, n, k, 0, k, &tail);
+		}
+	}
+	for(i = 0; i < n; ++i)
+		free(t[i].lens);
+	free(t);
+show:
+	mkrows(v);
+}
+
+/* FNV-1a hash of the packed columns of item */
+unsigned int
+itemhash(Item *item) {
+	unsigned char *p = (unsigned char *)item->data, *end = p + itemsize(item);
+	unsigned int h = 2166136261u;
+
+	while(p < end)
+		h = (h ^ *p++) * 16777619u;
+	return h;
+}
+
+/* size of the packed columns of item, as computed by rowsize() */
+size_t
+itemsize(Item *item) {
+	size_t sz = 3 * item->ncols * sizeof(int);
+	int i;
+
+	for(i = 0; i < item->ncols; ++i)
+		sz += ITEMLEN(item, i) + 1;
+	return (sz + sizeof(int) - 1) / sizeof(int) * sizeof(int);
+}
+
+void
+itempos(const Arg *arg) {
+	if(!selview)
+		return;
+	setpos(selview->cur + arg->i);
+}
+
+/* Kill the thread at the root of the blocking tree of the selected
+ * transaction. */
+void
+killblocker(const Arg *arg) {
+	Item *item = getitem(0);
+	char msg[128];
+	unsigned long id;
+
+	if(!item || !ITEMLEN(item, 2)) {
+		ui_set("status", "No blocking thread selected.");
+		return;
+	}
+	id = strtoul(ITEMCOL(item, 2), NULL, 10);
+	snprintf(msg, sizeof msg, "Kill thread %lu, the root blocker (y/[n])?", id);
+	if(ui_ask(msg, "ny") != 'y')
+		return;
+	if(mysql_exec("kill %lu", id) == -1) {
+		ui_set("status", "Cannot kill thread %lu: %s", id, mysql_error(mysql));
+		return;
+	}
+	reload(NULL);
+	ui_set("status", "Killed thread %lu.", id);
+}
+
+void
+limit(const Arg *arg) {
+	char pat[MAXPATLEN], old[MAXPATLEN];
+
+	if(!selview || !selview->all)
+		return;
+	snprintf(old, sizeof old, "%s", selview->filter);
+	snprintf(pat, sizeof pat, "%s", selview->filter);
+	if(ui_input("Limit to: ", pat, sizeof pat, 0, limit_update) < 0)
+		limit_update(old);
+}
+
+void
+limit_update(const char *pat) {
+	int id = -1, pos;
+
+	if(selview->nrows)
+		id = selview->rows[selview->cur];
+	filterrows(selview, pat);
+	for(pos = 0; pos < selview->nrows && selview->rows[pos] != id; ++pos);
+	selview->cur = (pos < selview->nrows ? pos : 0);
+	selview->top = 0;
+	ui_showitems(selview->lens);
+	setpos(selview->cur);
+}
+
+/* Find the first occurrence of p[0..m) in s[0..n). Candidates are the
+ * positions where both the first and the last byte of the pattern match;
+ * they are found a whole vector at a time and only then compared. */
+const char *
+memfind(const char *s, size_t n, const char *p, size_t m) {
+	const char *e;
+	size_t i = 0;
+	unsigned int mask;
+
+	if(!m)
+		return s;
+	if(m > n)
+		return NULL;
+#if defined __AVX2__
+	{
+		__m256i first = _mm256_set1_epi8(p[0]), last = _mm256_set1_epi8(p[m - 1]);
+
+		for(; i + m + 31 <= n; i += 32) {
+			mask = _mm256_movemask_epi8(_mm256_and_si256(
+				_mm256_cmpeq_epi8(first, _mm256_loadu_si256((const __m256i *)&s[i])),
+				_mm256_cmpeq_epi8(last, _mm256_loadu_si256((const __m256i *)&s[i + m - 1]))));
+			for(; mask; mask &= mask - 1)
+				if(!memcmp(&s[i + __builtin_ctz(mask) + 1], &p[1], m - 1))
+					return &s[i + __builtin_ctz(mask)];
+		}
+	}
+#elif defined __SSE2__
+	{
+		__m128i first = _mm_set1_epi8(p[0]), last = _mm_set1_epi8(p[m - 1]);
+
+		for(; i + m + 15 <= n; i += 16) {
+			mask = _mm_movemask_epi8(_mm_and_si128(
+				_mm_cmpeq_epi8(first, _mm_loadu_si128((const __m128i *)&s[i])),
+				_mm_cmpeq_epi8(last, _mm_loadu_si128((const __m128i *)&s[i + m - 1]))));
+			for(; mask; mask &= mask - 1)
+				if(!memcmp(&s[i + __builtin_ctz(mask) + 1], &p[1], m - 1))
+					return &s[i + __builtin_ctz(mask)];
+		}
+	}
+#endif
+	for(e = &s[n - m + 1], s = &s[i]; s < e && (s = memchr(s, p[0], e - s)); ++s)
+		if(!memcmp(&s[1], &p[1], m - 1))
+			return s;
+	return NULL;
+}
+
+Field *
+mkfield(const char *name, enum enum_field_types type) {
+	Field *field;
+
+	field = ecalloc(1, sizeof(Field));
+	snprintf(field->name, sizeof field->name, "%s", name);
+	field->len = strlen(field->name);
+	field->width = strwidth(field->name, field->len);
+	field->type = type;
+	return field;
+}
+
+/* Make an item of v out of cols, held in memory. */
+Item *
+mkitem(View *v, char **cols, unsigned long *lens, int ncols) {
+	Item *item;
+	size_t sz;
+
+	sz = rowsize(lens, ncols);
+	item = ecalloc(1, sizeof(Item) + sz);
+	item->data = (char *)&item[1];
+	item->ncols = ncols;
+	packrow(item->data, cols, lens, ncols);
+	v->ram += sizeof(Item) + sz;
+	return item;
+}
+
+void
+mkrows(View *v) {
+	char pat[MAXPATLEN];
+	Item *item;
+	int i;
+
+	/* the items in memory come first, then the spilled rows */
+	for(item = v->items, v->nram = 0; item; item = item->next, ++v->nram);
+	v->all = ecalloc(v->nram + 1, sizeof(Item *));
+	v->order = rowalloc(v, v->nitems, sizeof(int));
+	v->rows = rowalloc(v, v->nitems, sizeof(int));
+	for(item = v->items, i = 0; item; item = item->next, ++i)
+		v->all[i] = item;
+	for(i = 0; i < v->nitems; ++i)
+		v->order[i] = i;
+	if(v->sortcol)
+		sortrows(v);
+	if(v->seen)
+		watchmark(v);
+	memcpy(pat, v->filter, sizeof pat);
+	v->filter[0] = '\0';
+	filterrows(v, pat);
+}
+
+void
+mksql_alter_table(char *sql, char *tbl) {
+	MYSQL_RES *res;
+	MYSQL_ROW row;
+	char *p;
+	int size = MAXQUERYLEN, len = 0, r;
+
+	*sql = '\0';
+	r = mysql_exec("show create table `%s`", tbl);
+	if(r == -1 || !(res = mysql_store_result(mysql)) || !(row = mysql_fetch_row(res)))
+		return;
+	mysql_free_result(res);
+	len += snprintf(&sql[len], size - len + 1, "ALTER TABLE `%s`", tbl);
+	for(r = 0, p = &row[1][0]; row[1][r]; ++r) {
+		if(row[1][r] != '\n')
+			continue;
+		while(*p == ' ')
+			++p;
+		if(*p == '`') {
+			row[1][r] = '\0';
+			len += snprintf(&sql[len], size - len + 1, "\nMODIFY %s", p);
+		}
+		p = &row[1][r + 1];
+	}
+	if(sql[len - 1] == ',')
+		sql[len - 1] = '\0';
+}
+
+void
+mksql_update(char *sql, Item *item, Field *fields, char *tbl, char *uk) {
+	Field *fld;
+	char *ukv = NULL, sqlfds[MAXQUERYLEN+1], col[MAXQUERYLEN];
+	int size = MAXQUERYLEN, len = 0, i;
 
 	for(i = 0, fld = fields; fld; fld = fld->next, ++i) {
 		if(!ukv && !strncmp(uk, fld->name, fld->len))
-			ukv = item->cols[i];
-		escape(col, item->cols[i], item->lens[i], '\'', 0);
+			ukv = ITEMCOL(item, i);
+		escape(col, ITEMCOL(item, i), ITEMLEN(item, i), '\'', 0);
 		len += snprintf(&sqlfds[len], size - len + 1, "\n%c`%s` = '%s'",
 			len ? ',' : ' ', fld->name, col);
 	}
-	snprintf(sql, MAXQUERYLEN+1, "UPDATE `%s` SET%s\nWHERE `%s` = '%s'",
-		tbl, sqlfds, uk, ukv);
+	snprintf(sql, MAXQUERYLEN+1, "UPDATE `%s` SET%s\nWHERE `%s` = '%s'",
+		tbl, sqlfds, uk, ukv);
+}
+
+/* Turn what the user typed into a clause to append to "select * from tbl".
+ * A lone column=value pair on a known column is quoted for the user, clauses
+ * starting with WHERE, ORDER BY or LIMIT are kept and anything else is taken
+ * as a WHERE condition. */
+void
+mksql_where(char *sql, int sz, const char *clause, Field *fields) {
+	Field *fld;
+	char val[MAXPATLEN*8+1];
+	const char *v;
+	int n;
+
+	while(isspace((unsigned char)*clause))
+		++clause;
+	*sql = '\0';
+	if(!*clause)
+		return;
+	if((!strncasecmp(clause, "where", 5) || !strncasecmp(clause, "order", 5)
+	|| !strncasecmp(clause, "limit", 5)) && isspace((unsigned char)clause[5])) {
+		snprintf(sql, sz, "%s", clause);
+		return;
+	}
+	for(n = 0; isalnum((unsigned char)clause[n]) || clause[n] == '_' || clause[n] == '$'; ++n);
+	for(v = &clause[n]; *v == ' '; ++v);
+	if(n && *v == '=') {
+		for(++v; *v == ' '; ++v);
+		for(fld = fields; fld; fld = fld->next)
+			if(fld->len == n && !strncmp(fld->name, clause, n))
+				break;
+		if(fld && *v && !strpbrk(v, " \t'\"")) {
+			mysql_real_escape_string(mysql, val, v, strlen(v));
+			snprintf(sql, sz, "WHERE `%s` = '%s'", fld->name, val);
+			return;
+		}
+	}
+	snprintf(sql, sz, "WHERE %s", clause);
+}
+
+int
+mysql_exec(const char *sqlstr, ...) {
+	va_list ap;
+	char sql[MAXQUERYLEN+1];
+	int r, sqlen;
+
+	va_start(ap, sqlstr);
+	sqlen = vsnprintf(sql, sizeof sql, sqlstr, ap);
+	va_end(ap);
+	r = mysql_real_query(mysql, sql, sqlen);
+	return (r ? -1 : mysql_field_count(mysql));
+}
+
+/* Ask the optimizer how many rows sql would examine and whether it has to
+ * scan the whole table to do so. */
+int
+mysql_explain(const char *sql, unsigned long long *rows, int *fullscan) {
+	MYSQL_RES *res;
+	MYSQL_ROW row;
+	MYSQL_FIELD *fds;
+	int nfds, i, irows = -1, ikey = -1, itype = -1;
+
+	*rows = 0;
+	*fullscan = 0;
+	if(mysql_exec("explain %s", sql) == -1 || !(res = mysql_store_result(mysql)))
+		return -1;
+	nfds = mysql_num_fields(res);
+	fds = mysql_fetch_fields(res);
+	for(i = 0; i < nfds; ++i) {
+		if(!strcasecmp(fds[i].name, "rows"))
+			irows = i;
+		else if(!strcasecmp(fds[i].name, "key"))
+			ikey = i;
+		else if(!strcasecmp(fds[i].name, "type"))
+			itype = i;
+	}
+	while((row = mysql_fetch_row(res))) {
+		if(irows != -1 && row[irows])
+			*rows += strtoull(row[irows], NULL, 10);
+		if(ikey != -1 && !row[ikey] && itype != -1 && row[itype]
+		&& !strcmp(row[itype], "ALL"))
+			*fullscan = 1;
+	}
+	mysql_free_result(res);
+	return 0;
+}
+
+/* Run sql and store its result, unless startup_job() already did. */
+MYSQL_RES *
+mysql_store(const char *sql) {
+	MYSQL_RES *res;
+	int i;
+
+	for(i = 0; i < LENGTH(actions); ++i) {
+		if(prefetched[i] && actions[i].query && !strcmp(actions[i].query, sql)) {
+			res = prefetched[i];
+			prefetched[i] = NULL;
+			return res;
+		}
+	}
+	if(mysql_exec("%s", sql) == -1)
+		return NULL;
+	return mysql_store_result(mysql);
+}
+
+int
+mysql_fields(MYSQL_RES *res, Field **fields) {
+	MYSQL_FIELD *fds;
+	Field *field;
+	int nfds, i;
+
+	nfds = mysql_num_fields(res);
+	if(!nfds)
+		return 0;
+	fds = mysql_fetch_fields(res);
+	for(i = 0; i < nfds; ++i) {
+		field = ecalloc(1, sizeof(Field));
+		field->len = (fds[i].name_length < MYSQLIDLEN ? fds[i].name_length : MYSQLIDLEN - 1);
+		field->type = fds[i].type;
+		memcpy(field->name, fds[i].name, field->len);
+		field->width = strwidth(field->name, field->len);
+		attachfield(field, fields);
+	}
+	return nfds;
+}
+
+int
+mysql_file_exec(char *file) {
+	char buf[MAXQUERYLEN+1], esc[MAXQUERYLEN*2+1];
+	int fd, size, r;
+
+	fd = open(file, O_RDONLY);
+	if(fd == -1)
+		return -1;
+	size = read(fd, buf, MAXQUERYLEN);
+	if(size == -1)
+		return -2;
+	if(!size)
+		return 0;
+	buf[size] = '\0';
+	/* We do not want flow control chars to be interpreted. */
+	size += escape(esc, buf, size, '\\', '\'');
+	r = mysql_exec(esc);
+	if(r == -1)
+		return -3;
+	return size;
+}
+
+void
+mysql_fillview(MYSQL_RES *res, int showfds) {
+	cleanuprows(selview);
+	cleanupitems(&selview->items);
+	cleanupspill(selview);
+	selview->nitems = mysql_items(res, selview);
+	if(showfds) {
+		cleanupfields(&selview->fields);
+		selview->nfields = mysql_fields(res, &selview->fields);
+	}
+	mkrows(selview);
+}
+
+double
+now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int
+mysql_ukey(char *key, char *tbl, int sz) {
+	MYSQL_RES *res;
+	MYSQL_ROW row;
+	int r;
+
+	r = mysql_exec("show keys from `%s` where Non_unique = 0", tbl);
+	if(r == -1 || !(res = mysql_store_result(mysql)))
+		return 1;
+	if(!(row = mysql_fetch_row(res))) {
+		mysql_free_result(res);
+		return 2;
+	}
+	snprintf(key, sz, "%s", row[4]);
+	mysql_free_result(res);
+	return 0;
+}
+
+/* Get the columns of the first unique key of tbl, the primary one if any.
+ * Returns how many, 0 if there is no such key and -1 on error. */
+int
+mysql_ukeys(const char *tbl, char (*cols)[4 * MYSQLIDLEN], int max) {
+	MYSQL_RES *res;
+	MYSQL_ROW row;
+	char kname[4 * MYSQLIDLEN] = "";
+	int r, n = 0;
+
+	r = mysql_exec("show keys from %s where Non_unique = 0", tbl);
+	if(r == -1 || !(res = mysql_store_result(mysql)))
+		return -1;
+	while(n < max && (row = mysql_fetch_row(res)) && (!n || !strcmp(row[2], kname))) {
+		snprintf(kname, sizeof kname, "%s", row[2]);
+		snprintf(cols[n++], sizeof cols[0], "%s", row[4]);
+	}
+	mysql_free_result(res);
+	return n;
+}
+
+/* Load the rows of res in the items of v. Past rambudget bytes the rows left
+ * are appended to a temporary file instead and their offsets to another, both
+ * mapped once loaded: spilled rows get no item, only the pages being looked
+ * at need to be in memory. Their widths are taken meanwhile, so that laying
+ * the columns out does not read the file again. */
+int
+mysql_items(MYSQL_RES *res, View *v) {
+	MYSQL_ROW row;
+	Item *item, **tail, tmp;
+	FILE *fp = NULL, *fo = NULL;
+	char *buf = NULL;
+	size_t sz, bufsz = 0;
+	int nfds, nrows = 0, i;
+	unsigned long *lens;
+
+	nfds = mysql_num_fields(res);
+	v->items = NULL;
+	tail = &v->items;
+	while((row = mysql_fetch_row(res))) {
+		lens = mysql_fetch_lengths(res);
+		sz = rowsize(lens, nfds);
+		if(!fp && rambudget && v->ram + sz > rambudget && (fp = spillfile())
+		&& !(fo = spillfile())) {
+			fclose(fp);
+			fp = NULL;
+		}
+		if(fp) {
+			if(sz > bufsz) {
+				free(buf);
+				buf = ecalloc(1, bufsz = sz);
+			}
+			memset(buf, 0, sz);
+			packrow(buf, row, lens, nfds);
+			if(fwrite(buf, sz, 1, fp) != 1
+			|| fwrite(&v->spillsz, sizeof v->spillsz, 1, fo) != 1)
+				die("Cannot write the spill file.\n");
+			v->spillsz += sz;
+			if(!v->spillw)
+				v->spillw = ecalloc(nfds, sizeof(int));
+			tmp.data = buf;
+			tmp.ncols = v->spillcols = nfds;
+			for(i = 0; i < nfds; ++i)
+				if(v->spillw[i] < ITEMWIDTH(&tmp, i))
+					v->spillw[i] = ITEMWIDTH(&tmp, i);
+			++v->nspill;
+		}
+		else {
+			item = mkitem(v, row, lens, nfds);
+			*tail = item;
+			tail = &item->next;
+		}
+		++nrows;
+	}
+	free(buf);
+	if(fp) {
+		if(fflush(fp) || fflush(fo))
+			die("Cannot write the spill file.\n");
+		v->spill = mmap(NULL, v->spillsz, PROT_READ, MAP_SHARED, fileno(fp), 0);
+		v->spilloff = mmap(NULL, v->nspill * sizeof(size_t), PROT_READ, MAP_SHARED,
+			fileno(fo), 0);
+		/* the mappings keep the files */
+		fclose(fp);
+		fclose(fo);
+		if(v->spill == MAP_FAILED || v->spilloff == MAP_FAILED)
+			die("Cannot map the spill file.\n");
+	}
+	return nrows;
+}
+
+/* Stable merge sort of the row indexes in a, tmp being as large as a. */
+void
+msort(const Sort *s, int *a, int *tmp, int n) {
+	int i, j, x;
+
+	if(n < 16) {
+		for(i = 1; i < n; ++i) {
+			for(x = a[i], j = i; j > 0 && sortcmp(s, a[j - 1], x) > 0; --j)
+				a[j] = a[j - 1];
+			a[j] = x;
+		}
+		return;
+	}
+	msort(s, a, tmp, n / 2);
+	msort(s, &a[n / 2], tmp, n - n / 2);
+	merge(s, a, n / 2, &a[n / 2], n - n / 2, tmp);
+	memcpy(a, tmp, n * sizeof(int));
+}
+
+void *
+msort_job(void *job) {
+	SortJob *j = job;
+
+	msort(j->s, &j->src[j->lo], &j->dst[j->lo], j->hi - j->lo);
+	return NULL;
+}
+
+void
+merge(const Sort *s, const int *a, int na, const int *b, int nb, int *out) {
+	while(na && nb) {
+		if(sortcmp(s, *b, *a) < 0) {
+			*out++ = *b++;
+			--nb;
+		}
+		else {
+			*out++ = *a++;
+			--na;
+		}
+	}
+	memcpy(out, a, na * sizeof(int));
+	memcpy(&out[na], b, nb * sizeof(int));
+}
+
+void *
+merge_job(void *job) {
+	SortJob *j = job;
+
+	merge(j->s, &j->src[j->lo], j->mid - j->lo, &j->src[j->mid], j->hi - j->mid,
+		&j->dst[j->lo]);
+	return NULL;
+}
+
+void
+ui_listview(Item *items, Field *fields) {
+	int *lens, i;
+
+	if(!selview->form)
+		selview->form = ui_getform(FRAG_ITEMS);
+	free(selview->lens);
+	selview->lens = lens = getmaxlengths(items, fields);
+	/* the widths of the spilled rows were taken while loading them */
+	if(selview->spillw && !lens)
+		selview->lens = lens = ecalloc(selview->spillcols, sizeof(int));
+	for(i = 0; selview->spillw && i < selview->spillcols; ++i)
+		if(lens[i] < selview->spillw[i])
+			lens[i] = (selview->spillw[i] <= MAXCOLSZ ? selview->spillw[i] : MAXCOLSZ);
+	ui_showfields(fields, lens);
+	/* even with no rows, not to leave the previous ones on screen */
+	ui_showitems(lens);
+}
+
+void
+ui_showfields(Field *fds, int *lens) {
+	Field *fld;
+	char line[COLS * MB_LEN_MAX + 1];
+	int li = 0, col = 0, i, j, w;
+
+	line[0] = '\0';
+	for(fld = fds, i = 0; fld && lens && col < COLS; fld = fld->next, ++i) {
+		if(i)
+			for(j = 0; j < fldseplen && col < COLS; ++j, ++col)
+				line[li++] = FLDSEP[j];
+		w = (lens[i] < COLS - col ? lens[i] : COLS - col);
+		li += putcell(&line[li], sizeof line - li, fld->name, fld->len, w);
+		col += w;
+	}
+	line[li] = '\0';
+	ui_set("subtle", "%s", line);
+	ui_set("showsubtle", "%d", (line[0] ? 1 : 0));
+}
+
+void
+ui_showitems(int *lens) {
+	Item tmp;
+	int h = ui_listheight(), i;
+
+	if(selview->cur >= selview->nrows)
+		selview->cur = (selview->nrows ? selview->nrows - 1 : 0);
+	if(selview->top > selview->cur)
+		selview->top = selview->cur;
+	else if(selview->cur >= selview->top + h)
+		selview->top = selview->cur - h + 1;
+	/* the whole window in one go, instead of an stfl_modify() per row */
+	framelen = 0;
+	framewcs(L"{vbox");
+	for(i = selview->top; i < selview->nrows && i < selview->top + h; ++i)
+		ui_putitem(rowitem(selview, selview->rows[i], &tmp), lens, i + 1,
+			(selview->changed && selview->changed[selview->rows[i]]));
+	framewcs(L"}");
+	if(selview->form)
+		stfl_modify(selview->form, L"items", L"replace_inner", frame);
+	ui_set("pos", "%d", selview->cur - selview->top);
+}
+
+void
+ui_sql_edit_exec(char *sql) {
+	struct stat sb, sa;
+	int fd;
+	char tmpf[] = "/tmp/myadm.XXXXXX";
+
+        fd = mkstemp(tmpf);
+	if(fd == -1) {
+		ui_set("status", "Cannot make a temporary file.");
+		return;
+	}
+        if(write(fd, sql, strlen(sql)) == -1) {
+		close(fd);
+		unlink(tmpf);
+		ui_set("status", "Cannot write into the temporary file.");
+		return;
+	}
+	close(fd);
+	stat(tmpf, &sb);
+	while(1) {
+		editfile(tmpf);
+		stat(tmpf, &sa);
+		if(!sa.st_size || sb.st_mtime == sa.st_mtime) {
+			ui_set("status", "No changes.");
+			break;
+		}
+		if(mysql_file_exec(tmpf) < 0) {
+			if(*mysql_error(mysql)) {
+				if(ui_ask("An error occurred. Continue editing ([y]/n)?", "yn") == 'y')
+					continue;
+			}
+			else
+				ui_set("status", "Something went wrong.");
+			break;
+		}
+		reload(NULL);
+		ui_set("status", "Updated.");
+		break;
+	}
+	unlink(tmpf);
+}
+
+/* Pack a row in data, rowsize() bytes long: the lengths, display widths and
+ * offsets of the columns, then the columns themselves, NUL terminated. */
+void
+packrow(char *data, MYSQL_ROW row, unsigned long *lens, int ncols) {
+	int *hdr = (int *)data, off = 3 * ncols * sizeof(int), i;
+
+	for(i = 0; i < ncols; ++i) {
+		hdr[i] = lens[i];
+		hdr[ncols + i] = (row[i] ? strwidth(row[i], lens[i]) : 0);
+		hdr[2 * ncols + i] = off;
+		if(row[i])
+			memcpy(&data[off], row[i], lens[i]);
+		data[off + lens[i]] = '\0';
+		off += lens[i] + 1;
+	}
+}
+
+/* Write s[0..len) in buf so that it takes exactly w columns on screen: it is
+ * cut before the first character not fitting, along with the combining
+ * characters following it, or padded with blanks. Characters which cannot be
+ * printed are shown as blanks. Returns the number of bytes written. */
+int
+putcell(char *buf, int sz, const char *s, int len, int w) {
+	mbstate_t ps;
+	wchar_t wc;
+	size_t n;
+	int bi = 0, col = 0, cw, i;
+
+	if(isprintascii(s, len)) {
+		bi = (len < w ? len : w);
+		if(bi > sz - 1)
+			bi = sz - 1;
+		memcpy(buf, s, bi);
+		col = bi;
+	}
+	else {
+		memset(&ps, 0, sizeof ps);
+		for(i = 0; i < len; i += n) {
+			n = mbrtowc(&wc, &s[i], len - i, &ps);
+			if(n == (size_t)-1 || n == (size_t)-2 || !n) {
+				memset(&ps, 0, sizeof ps);
+				n = 1;
+				wc = L'\0';
+			}
+			if(iswprint(wc) && (cw = wcwidth(wc)) >= 0) {
+				if(col + cw > w || bi + (int)n >= sz)
+					break;
+				memcpy(&buf[bi], &s[i], n);
+				bi += n;
+			}
+			else {
+				if(col + (cw = 1) > w || bi + 1 >= sz)
+					break;
+				buf[bi++] = ' ';
+			}
+			col += cw;
+		}
+	}
+	for(; col < w && bi < sz - 1; ++col)
+		buf[bi++] = ' ';
+	return bi;
+}
+
+void
+quit(const Arg *arg) {
+	if(arg->i && ui_ask("Do you want to quit ([y]/n)?", "yn") != 'y')
+		return;
+	running = 0;
+}
+
+void
+reload(const Arg *arg) {
+	if(!(selview && selview->show))
+		return;
+	selview->show();
+	govern();
+	setpos(selview->cur);
+}
+
+/* Allocate an array of nmemb per row values of v, zeroed. Once v has rows
+ * spilled, the array goes in a mapped temporary file as well, so that it
+ * does not pin memory either. Freed with rowfree(). */
+void *
+rowalloc(View *v, size_t nmemb, size_t size) {
+	size_t sz = 2 * sizeof(size_t) + nmemb * size, *p = MAP_FAILED;
+	FILE *fp;
+
+	if(v->spill && (fp = spillfile())) {
+		if(!ftruncate(fileno(fp), sz))
+			p = mmap(NULL, sz, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(fp), 0);
+		fclose(fp);
+	}
+	/* the size of the mapping ahead of the array, 0 if allocated */
+	if(p == MAP_FAILED) {
+		p = ecalloc(1, sz);
+		sz = 0;
+	}
+	p[0] = sz;
+	return &p[2];
+}
+
+void
+rowfree(void *p) {
+	size_t *hdr = p;
+
+	if(!hdr)
+		return;
+	hdr -= 2;
+	if(hdr[0])
+		munmap(hdr, hdr[0]);
+	else
+		free(hdr);
+}
+
+/* Row id of v, either one of its items or a spilled row, pointed to by tmp. */
+Item *
+rowitem(View *v, int id, Item *tmp) {
+	if(id < v->nram)
+		return v->all[id];
+	tmp->data = &v->spill[v->spilloff[id - v->nram]];
+	tmp->ncols = v->spillcols;
+	tmp->next = NULL;
+	return tmp;
+}
+
+int
+rowmatch(View *v, int id, const char *pat, size_t m) {
+	return memfind(&v->sbuf[v->soff[id]], v->soff[id + 1] - v->soff[id], pat, m) != NULL;
+}
+
+size_t
+rowsize(unsigned long *lens, int ncols) {
+	size_t sz = 3 * ncols * sizeof(int);
+	int i;
+
+	for(i = 0; i < ncols; ++i)
+		sz += lens[i] + 1;
+	return (sz + sizeof(int) - 1) / sizeof(int) * sizeof(int);
+}
+
+void
+run(void) {
+	int code, i, done;
+
+	while(running) {
+		schemapoll();
+		copypoll();
+		trxpoll();
+		watchpoll();
+		if(starting) {
+			pthread_mutex_lock(&startlock);
+			done = started;
+			pthread_mutex_unlock(&startlock);
+			if(done)
+				startup();
+			else
+				ui_set("status", "Connecting... %.1fs", now() - tstart);
+		}
+		ui_refresh();
+		/* poll while threads are on their way, block otherwise */
+		for(i = 0; i < LENGTH(schemas) && schemas[i].state != 1
+		&& schemas[i].state != 2; ++i);
+		timeout(starting || i < LENGTH(schemas) || copy.state || trxjob.state
+			|| (selview && selview->watch) ? 100 : -1);
+		code = getch();
+		timeout(-1);
+		if(code < 0)
+			continue;
+		if(code == KEY_RESIZE && selview && selview->all) {
+			ui_showitems(selview->lens);
+			continue;
+		}
+		for(i = 0; i < LENGTH(keys); ++i) {
+			if(!selview && keys[i].func != quit)
+				continue;
+			if(ISCURVIEW(keys[i].view) && keys[i].code == code) {
+				ui_set("status", "");
+				keys[i].func(&keys[i].arg);
+				break;
+			}
+		}
+	}
 }
 
-int
-mysql_exec(const char *sqlstr, ...) {
-	va_list ap;
-	char sql[MAXQUERYLEN+1];
-	int r, sqlen;
-
-	va_start(ap, sqlstr);
-	sqlen = vsnprintf(sql, sizeof sql, sqlstr, ap);
-	va_end(ap);
-	r = mysql_real_query(mysql, sql, sqlen);
-	return (r ? -1 : mysql_field_count(mysql));
+void
+schemaclose(int conn) {
+	if(schemas[conn].map)
+		munmap(schemas[conn].map, schemas[conn].size);
+	schemas[conn].map = NULL;
+	schemas[conn].size = 0;
 }
 
-int
-mysql_fields(MYSQL_RES *res, Field **fields) {
-	MYSQL_FIELD *fds;
-	Field *field;
-	int nfds, i;
+SchemaDb *
+schemadb(const char *map, const char *name) {
+	SchemaHdr *hdr = (SchemaHdr *)map;
+	SchemaDb *dbs = (SchemaDb *)&hdr[1];
+	int lo = 0, hi = hdr->ndbs - 1, mid, r;
 
-	nfds = mysql_num_fields(res);
-	if(!nfds)
-		return 0;
-	fds = mysql_fetch_fields(res);
-	for(i = 0; i < nfds; ++i) {
-		field = ecalloc(1, sizeof(Field));
-		field->len = fds[i].name_length;
-		memcpy(field->name, fds[i].name, field->len);
-		attachfield(field, fields);
+	while(lo <= hi) {
+		mid = (lo + hi) / 2;
+		if(!(r = strcmp(name, &map[dbs[mid].name])))
+			return &dbs[mid];
+		if(r < 0)
+			hi = mid - 1;
+		else
+			lo = mid + 1;
 	}
-	return nfds;
+	return NULL;
 }
 
+/* Fill v with the databases, or the tables of db, in the schema index of its
+ * profile. Returns -1 if they are not indexed. */
 int
-mysql_file_exec(char *file) {
-	char buf[MAXQUERYLEN+1], esc[MAXQUERYLEN*2+1];
-	int fd, size, r;
+schemafill(View *v, const char *db) {
+	char *map = schemas[v->conn].map, *col;
+	SchemaHdr *hdr;
+	SchemaDb *dbs, *d;
+	unsigned int *tables;
+	unsigned long len;
+	Item **tail;
+	unsigned int i, first, n;
 
-	fd = open(file, O_RDONLY);
-	if(fd == -1)
+	if(!map)
 		return -1;
-	size = read(fd, buf, MAXQUERYLEN);
-	if(size == -1)
-		return -2;
-	if(!size)
-		return 0;
-	buf[size] = '\0';
-	/* We do not want flow control chars to be interpreted. */
-	size += escape(esc, buf, size, '\\', '\'');
-	r = mysql_exec(esc);
-	if(r == -1)
-		return -3;
-	return size;
+	hdr = (SchemaHdr *)map;
+	dbs = (SchemaDb *)&hdr[1];
+	tables = (unsigned int *)&dbs[hdr->ndbs];
+	if(db) {
+		if(!(d = schemadb(map, db)))
+			return -1;
+		first = d->first;
+		n = d->ntables;
+	}
+	else {
+		first = 0;
+		n = hdr->ndbs;
+	}
+	cleanuprows(v);
+	cleanupitems(&v->items);
+	cleanupspill(v);
+	for(tail = &v->items, i = first; i < first + n; ++i) {
+		col = &map[(db ? tables[i] : dbs[i].name)];
+		len = strlen(col);
+		*tail = mkitem(v, &col, &len, 1);
+		tail = &(*tail)->next;
+	}
+	v->nitems = n;
+	mkrows(v);
+	return 0;
 }
 
+/* Bring the schema index of a profile up to date. The databases are checked
+ * with a single query against a signature made of the number of their tables,
+ * the last time one was created or updated and a checksum of their names; the
+ * tables are only listed again for the databases whose signature changed. */
+void *
+schema_job(void *arg) {
+	int conn = (Schema *)arg - schemas;
+	char *map = schemas[conn].map, path[PATH_MAX], err[256];
+	char sql[MAXQUERYLEN+1], *esc, *tbl;
+	MYSQL *m;
+	MYSQL_RES *res;
+	MYSQL_ROW row;
+	SchemaDb *old;
+	Db *dbs = NULL, key, *d;
+	unsigned int *tables;
+	int ndbs = 0, nchanged = 0, len, i, j;
+
+	mysql_thread_init();
+	if(!(m = dbopen(conn, err, sizeof err)))
+		goto out;
+	if(mysql_query(m, "select s.SCHEMA_NAME, concat(count(t.TABLE_NAME), '/', "
+			"coalesce(max(coalesce(t.UPDATE_TIME, t.CREATE_TIME)), ''), '/', "
+			"coalesce(sum(crc32(t.TABLE_NAME)), 0)) "
+			"from information_schema.SCHEMATA s left join information_schema.TABLES t "
+			"on t.TABLE_SCHEMA = s.SCHEMA_NAME group by s.SCHEMA_NAME")
+	|| !(res = mysql_store_result(m)))
+		goto close;
+	dbs = ecalloc(mysql_num_rows(res) + 1, sizeof(Db));
+	while((row = mysql_fetch_row(res))) {
+		d = &dbs[ndbs++];
+		d->name = strdup(row[0]);
+		d->sig = strdup(row[1] ? row[1] : "");
+		old = (map ? schemadb(map, d->name) : NULL);
+		d->changed = !(old && !strcmp(&map[old->sig], d->sig));
+		nchanged += d->changed;
+		if(d->changed)
+			continue;
+		tables = (unsigned int *)&((SchemaDb *)&((SchemaHdr *)map)[1])[((SchemaHdr *)map)->ndbs];
+		d->ntables = old->ntables;
+		d->tables = ecalloc(d->ntables + 1, sizeof(char *));
+		for(i = 0; i < d->ntables; ++i)
+			d->tables[i] = strdup(&map[tables[old->first + i]]);
+	}
+	mysql_free_result(res);
+	qsort(dbs, ndbs, sizeof(Db), cmpdb);
+	if(map && !nchanged && ndbs == ((SchemaHdr *)map)->ndbs)
+		goto close; /* up to date */
+
+	/* list the tables of the databases which changed, or of all */
+	len = snprintf(sql, sizeof sql, "select TABLE_SCHEMA, TABLE_NAME from "
+		"information_schema.TABLES where TABLE_SCHEMA in (''");
+	for(i = 0; i < ndbs && len < sizeof sql; ++i) {
+		if(!dbs[i].changed)
+			continue;
+		esc = ecalloc(strlen(dbs[i].name) * 2 + 1, 1);
+		mysql_real_escape_string(m, esc, dbs[i].name, strlen(dbs[i].name));
+		len += snprintf(&sql[len], sizeof sql - len, ",'%s'", esc);
+		free(esc);
+	}
+	if(len + 2 >= sizeof sql) {
+		snprintf(sql, sizeof sql, "select TABLE_SCHEMA, TABLE_NAME from "
+			"information_schema.TABLES");
+		for(i = 0; i < ndbs; dbs[i++].changed = 1) {
+			for(j = 0; j < dbs[i].ntables; ++j)
+				free(dbs[i].tables[j]);
+			free(dbs[i].tables);
+			dbs[i].tables = NULL;
+			dbs[i].ntables = 0;
+		}
+	}
+	else
+		snprintf(&sql[len], sizeof sql - len, ")");
+	if(mysql_query(m, sql) || !(res = mysql_store_result(m)))
+		goto close;
+	while((row = mysql_fetch_row(res))) {
+		key.name = row[0];
+		if(!(d = bsearch(&key, dbs, ndbs, sizeof(Db), cmpdb)) || !d->changed)
+			continue;
+		if(!(d->ntables & (d->ntables + 1))) /* 0, 1, 3, 7... grow */
+			d->tables = realloc(d->tables, 2 * (d->ntables + 1) * sizeof(char *));
+		if(!d->tables || !(tbl = strdup(row[1])))
+			die("Cannot allocate memory.\n");
+		d->tables[d->ntables++] = tbl;
+	}
+	mysql_free_result(res);
+	for(i = 0; i < ndbs; ++i)
+		qsort(dbs[i].tables, dbs[i].ntables, sizeof(char *), cmpstr);
+	schemapath(conn, path, sizeof path);
+	schemawrite(path, dbs, ndbs);
+close:
+	mysql_close(m);
+out:
+	for(i = 0; i < ndbs; ++i) {
+		for(j = 0; j < dbs[i].ntables; ++j)
+			free(dbs[i].tables[j]);
+		free(dbs[i].tables);
+		free(dbs[i].name);
+		free(dbs[i].sig);
+	}
+	free(dbs);
+	mysql_thread_end();
+	pthread_mutex_lock(&schemalock);
+	schemas[conn].state = 2;
+	pthread_mutex_unlock(&schemalock);
+	return NULL;
+}
+
+/* Map the schema index of a profile, if any and sane. */
 void
-mysql_fillview(MYSQL_RES *res, int showfds) {
-	cleanupitems(&selview->items);
-	selview->nitems = mysql_items(res, &selview->items);
-	if(showfds) {
-		cleanupfields(&selview->fields);
-		selview->nfields = mysql_fields(res, &selview->fields);
+schemaopen(int conn) {
+	char path[PATH_MAX], *map;
+	struct stat sb;
+	SchemaHdr *hdr;
+	SchemaDb *dbs;
+	unsigned int *tables, i;
+	size_t end;
+	int fd;
+
+	schemaclose(conn);
+	schemapath(conn, path, sizeof path);
+	if((fd = open(path, O_RDONLY)) == -1)
+		return;
+	if(fstat(fd, &sb) || sb.st_size < sizeof(SchemaHdr)
+	|| (map = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		close(fd);
+		return;
+	}
+	close(fd);
+	schemas[conn].map = map;
+	schemas[conn].size = sb.st_size;
+	hdr = (SchemaHdr *)map;
+	dbs = (SchemaDb *)&hdr[1];
+	tables = (unsigned int *)&dbs[hdr->ndbs];
+	end = sizeof(SchemaHdr) + (size_t)hdr->ndbs * sizeof(SchemaDb)
+		+ (size_t)hdr->ntables * sizeof(int);
+	if(memcmp(hdr->magic, "myadmix1", 8) || end >= sb.st_size || map[sb.st_size - 1]) {
+		schemaclose(conn);
+		return;
+	}
+	for(i = 0; i < hdr->ndbs; ++i) {
+		if(dbs[i].name < end || dbs[i].name >= sb.st_size || dbs[i].sig < end
+		|| dbs[i].sig >= sb.st_size || dbs[i].first + dbs[i].ntables > hdr->ntables) {
+			schemaclose(conn);
+			return;
+		}
+	}
+	for(i = 0; i < hdr->ntables; ++i) {
+		if(tables[i] < end || tables[i] >= sb.st_size) {
+			schemaclose(conn);
+			return;
+		}
+	}
+}
+
+void
+schemapath(int conn, char *buf, int sz) {
+	char name[MYSQLIDLEN*2+6], *p;
+
+	snprintf(name, sizeof name, "%s@%s.idx", profiles[conn].user,
+		(*profiles[conn].host ? profiles[conn].host : "localhost"));
+	for(p = name; *p; ++p)
+		if(*p == '/')
+			*p = '_';
+	cachepath(name, buf, sz);
+}
+
+/* Pick up the indexes refreshed in the background, reloading the views which
+ * are listed from them. The state is left done meanwhile, so that this reload
+ * does not start another refresh. */
+void
+schemapoll(void) {
+	int i, done;
+
+	for(i = 0; i < LENGTH(schemas); ++i) {
+		pthread_mutex_lock(&schemalock);
+		done = (schemas[i].state == 2);
+		pthread_mutex_unlock(&schemalock);
+		if(!done)
+			continue;
+		pthread_join(schemas[i].tid, NULL);
+		schemaopen(i);
+		if(selview && selview->conn == i && (selview->show == viewdblist_show
+		|| selview->show == viewdb_show))
+			reload(NULL);
+		schemas[i].state = 0;
 	}
 }
 
+/* Start refreshing the schema index of a profile, unless already going on:
+ * the views listed from it are shown from the index meanwhile. */
+void
+schemarefresh(int conn) {
+	if(schemas[conn].state == 1 || schemas[conn].state == 2)
+		return;
+	schemas[conn].state = 1;
+	if(pthread_create(&schemas[conn].tid, NULL, schema_job, &schemas[conn]))
+		schemas[conn].state = 3;
+}
+
+/* Write the index atomically, through a temporary file renamed over it. */
 int
-mysql_ukey(char *key, char *tbl, int sz) {
-	MYSQL_RES *res;
-	MYSQL_ROW row;
-	int r;
+schemawrite(const char *path, Db *dbs, int ndbs) {
+	char tmp[PATH_MAX];
+	SchemaHdr hdr = {.magic = "myadmix1"};
+	SchemaDb db;
+	unsigned int off;
+	FILE *fp;
+	int i, j, r = 0;
 
-	r = mysql_exec("show keys from `%s` where Non_unique = 0", tbl);
-	if(r == -1 || !(res = mysql_store_result(mysql)))
-		return 1;
-	if(!(row = mysql_fetch_row(res))) {
-		mysql_free_result(res);
-		return 2;
+	cachedirs(path);
+	snprintf(tmp, sizeof tmp, "%s.%d", path, (int)getpid());
+	if(!(fp = fopen(tmp, "w")))
+		return -1;
+	hdr.ndbs = ndbs;
+	for(i = 0; i < ndbs; ++i)
+		hdr.ntables += dbs[i].ntables;
+	off = sizeof hdr + ndbs * sizeof(SchemaDb) + hdr.ntables * sizeof(int);
+	r |= fwrite(&hdr, sizeof hdr, 1, fp) != 1;
+	for(i = j = 0; i < ndbs; j += dbs[i++].ntables) {
+		db.name = off;
+		db.sig = (off += strlen(dbs[i].name) + 1);
+		db.first = j;
+		db.ntables = dbs[i].ntables;
+		off += strlen(dbs[i].sig) + 1;
+		r |= fwrite(&db, sizeof db, 1, fp) != 1;
+	}
+	for(i = 0; i < ndbs; ++i) {
+		for(j = 0; j < dbs[i].ntables; ++j) {
+			r |= fwrite(&off, sizeof off, 1, fp) != 1;
+			off += strlen(dbs[i].tables[j]) + 1;
+		}
+	}
+	for(i = 0; i < ndbs; ++i) {
+		r |= fwrite(dbs[i].name, strlen(dbs[i].name) + 1, 1, fp) != 1;
+		r |= fwrite(dbs[i].sig, strlen(dbs[i].sig) + 1, 1, fp) != 1;
+	}
+	for(i = 0; i < ndbs; ++i)
+		for(j = 0; j < dbs[i].ntables; ++j)
+			r |= fwrite(dbs[i].tables[j], strlen(dbs[i].tables[j]) + 1, 1, fp) != 1;
+	r |= fclose(fp);
+	if(r || rename(tmp, path)) {
+		unlink(tmp);
+		return -1;
 	}
-	snprintf(key, sz, "%s", row[4]);
-	mysql_free_result(res);
 	return 0;
 }
 
-int
-mysql_items(MYSQL_RES *res, Item **items) {
-	MYSQL_ROW row;
-	Item *item;
-	int i, nfds, nrows;
-	unsigned long *lens;
+void
+search(const Arg *arg) {
+	char pat[MAXPATLEN] = "";
+	int r, pos;
 
-	nfds = mysql_num_fields(res);
-	nrows = mysql_num_rows(res);
-	*items = NULL;
-	while((row = mysql_fetch_row(res))) {
-		item = ecalloc(1, sizeof(Item));
-		item->lens = ecalloc(nfds, sizeof(int));
-		item->cols = ecalloc(nfds, sizeof(char *));
-		lens = mysql_fetch_lengths(res);
-		item->ncols = nfds;
-		for(i = 0; i < nfds; ++i) {
-			item->cols[i] = ecalloc(1, lens[i]+1);
-			memcpy(item->cols[i], row[i], lens[i]);
-			item->lens[i] = lens[i];
+	if(!(selview && selview->nrows))
+		return;
+	searchfrom = selview->cur;
+	searchdir = arg->i;
+	r = ui_input(searchdir > 0 ? "Search for: " : "Reverse search for: ",
+			pat, sizeof pat, 0, search_update);
+	if(r < 0) {
+		setpos(searchfrom);
+		return;
+	}
+	if(r)
+		memcpy(searchpat, pat, sizeof searchpat);
+	else if((pos = findrow(searchpat, searchfrom + searchdir, searchdir)) >= 0)
+		setpos(pos);
+	if(*searchpat && findrow(searchpat, selview->cur, searchdir) < 0)
+		ui_set("status", "Not found.");
+}
+
+void
+search_update(const char *pat) {
+	int pos;
+
+	pos = findrow(pat, searchfrom, searchdir);
+	setpos(pos >= 0 ? pos : searchfrom);
+}
+
+/* Lay out the cells of all items, lowercased, one after the other in a single
+ * buffer. Cells are NUL separated so a pattern never matches across them. */
+void
+searchbuf(View *v) {
+	FILE *fp;
+	Item *item, tmp;
+	char *p, *col;
+	int i, j, k;
+
+	for(v->sbufsz = 1, i = 0; i < v->nitems; ++i)
+		for(item = rowitem(v, i, &tmp), j = 0; j < item->ncols; ++j)
+			v->sbufsz += ITEMLEN(item, j) + 1;
+	/* past the budget, the buffer goes in a mapped file like the rows */
+	if(rambudget && v->ram + v->sbufsz > rambudget && (fp = spillfile())) {
+		if(!ftruncate(fileno(fp), v->sbufsz)) {
+			v->sbuf = mmap(NULL, v->sbufsz, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(fp), 0);
+			v->sbufmapped = (v->sbuf != MAP_FAILED);
 		}
-		attachitem(item, items);
+		fclose(fp);
 	}
-	return nrows;
+	if(!v->sbufmapped)
+		v->sbuf = ecalloc(v->sbufsz, 1);
+	v->soff = rowalloc(v, v->nitems + 1, sizeof(size_t));
+	for(p = v->sbuf, i = 0; i < v->nitems; ++i) {
+		v->soff[i] = p - v->sbuf;
+		for(item = rowitem(v, i, &tmp), j = 0; j < item->ncols; ++j) {
+			col = ITEMCOL(item, j);
+			for(k = 0; k < ITEMLEN(item, j); ++k)
+				*p++ = tolower((unsigned char)col[k]);
+			*p++ = '\0';
+		}
+	}
+	v->soff[i] = p - v->sbuf;
 }
 
 void
-ui_listview(Item *items, Field *fields) {
-	int *lens;
+searchnext(const Arg *arg) {
+	int dir = searchdir * arg->i, pos;
 
-	if(!selview->form)
-		selview->form = ui_getform(FRAG_ITEMS);
-	lens = getmaxlengths(items, fields);
-	if(fields)
-		ui_showfields(fields, lens);
-	if(items)
-		ui_showitems(items, lens);
-	free(lens);
+	if(!(selview && selview->nrows))
+		return;
+	if(!*searchpat) {
+		ui_set("status", "No search pattern.");
+		return;
+	}
+	if((pos = findrow(searchpat, selview->cur + dir, dir)) < 0) {
+		ui_set("status", "Not found.");
+		return;
+	}
+	if((dir > 0 && pos <= selview->cur) || (dir < 0 && pos >= selview->cur))
+		ui_set("status", "Search wrapped.");
+	setpos(pos);
 }
 
 void
-ui_showfields(Field *fds, int *lens) {
-	Field *fld;
-	char line[COLS + 1];
-	int li = 0, i, j;
+setpos(int pos) {
+	char mem[32], budget[32];
+	int h = ui_listheight(), top;
+	size_t total = 0;
+	View *v;
 
-	if(!(fds && lens))
+	if(!selview)
+		return;
+	for(v = views; v; v = v->next)
+		total += viewbytes(v);
+	fmtbytes(mem, sizeof mem, total);
+	if(viewbudget)
+		fmtbytes(budget, sizeof budget, viewbudget);
+	else
+		snprintf(budget, sizeof budget, "unlimited");
+	if(!selview->nrows) {
+		selview->cur = selview->top = 0;
+		if(*selview->filter)
+			ui_set("info", "No items (limited to '%s'). [mem %s of %s]",
+				selview->filter, mem, budget);
+		else
+			ui_set("info", "No items. [mem %s of %s]", mem, budget);
 		return;
-	line[0] = '\0';
-	for(fld = fds, i = 0; fld && li < COLS; fld = fld->next, ++i) {
-		if(i)
-			for(j = 0; j < fldseplen && li < COLS; ++j)
-				line[li++] = FLDSEP[j];
-		for(j = 0; li < COLS && j < fld->len && j < lens[i]; ++j)
-			line[li++] = fld->name[j];
-		while(li < COLS && j++ < lens[i])
-			line[li++] = ' ';
 	}
-	line[li] = '\0';
-	ui_set("subtle", "%s", line);
-	ui_set("showsubtle", "%d", (line[0] ? 1 : 0));
+	if(pos >= selview->nrows)
+		pos = selview->nrows - 1;
+	if(pos < 0)
+		pos = 0;
+	selview->cur = pos;
+	top = selview->top;
+	if(pos < top)
+		top = pos;
+	else if(pos >= top + h)
+		top = pos - h + 1;
+	if(top != selview->top) {
+		selview->top = top;
+		ui_showitems(selview->lens);
+	}
+	else
+		ui_set("pos", "%d", pos - top);
+	if(*selview->filter)
+		ui_set("info", "%d of %d item(s) (limited to '%s', %d total) [mem %s of %s]",
+			pos + 1, selview->nrows, selview->filter, selview->nitems, mem, budget);
+	else
+		ui_set("info", "%d of %d item(s) [mem %s of %s]",
+			pos + 1, selview->nrows, mem, budget);
 }
 
 void
-ui_showitems(Item *items, int *lens) {
-	Item *item;
-	int id = 0;
+setview(const char *name, void (*show)(void)) {
+	View *v;
 
-	ui_modify("items", "replace_inner", "vbox"); /* empty items */
-	for(item = selview->items; item; item = item->next)
-		ui_putitem(item, lens, ++id);
-	ui_set("pos", "0");
+	v = ecalloc(1, sizeof(View));
+	/* a copy, the view it comes from may be evicted */
+	v->choice = itemdup(getitem(0));
+	strncpy(v->name, name, sizeof v->name);
+	v->show = show;
+	v->used = ++tick;
+	v->conn = curconn;
+	attach(v);
+	selview = v;
+	if(show)
+		show();
+	govern();
+}
+
+int
+sortcmp(const Sort *s, int x, int y) {
+	Item ta, tb, *a = rowitem(s->v, x, &ta), *b = rowitem(s->v, y, &tb);
+	int la, lb, r;
+
+	if(s->keys)
+		r = (s->keys[x] > s->keys[y]) - (s->keys[x] < s->keys[y]);
+	else {
+		la = ITEMLEN(a, s->col);
+		lb = ITEMLEN(b, s->col);
+		if(!(r = memcmp(ITEMCOL(a, s->col), ITEMCOL(b, s->col), (la < lb ? la : lb))))
+			r = la - lb;
+	}
+	return r * s->dir;
 }
 
+/* Sort the order of the view on its sort column. The rows are split in one
+ * chunk per thread, each chunk is merge sorted and then the chunks are merged
+ * pairwise, the merges of each pass running in parallel as well. */
 void
-ui_sql_edit_exec(char *sql) {
-	struct stat sb, sa;
+sortrows(View *v) {
+	Sort s = {.v = v, .col = v->sortcol - 1, .dir = v->sortdir};
+	SortJob *jobs;
+	Field *fld;
+	Item item;
+	int *tmp, *src, *dst, *bounds, *swp, nt, i, w;
+
+	if(v->nitems < 2)
+		return;
+	for(fld = v->fields, i = 0; fld && i < s.col; fld = fld->next, ++i);
+	if(fld && IS_NUM(fld->type)) {
+		s.keys = rowalloc(v, v->nitems, sizeof(double));
+		for(i = 0; i < v->nitems; ++i)
+			s.keys[i] = strtod(ITEMCOL(rowitem(v, i, &item), s.col), NULL);
+	}
+	nt = (sortthreads > 0 ? sortthreads : sysconf(_SC_NPROCESSORS_ONLN));
+	while(nt > 1 && v->nitems / nt < 4096)
+		nt /= 2;
+	if(nt < 1)
+		nt = 1;
+	tmp = rowalloc(v, v->nitems, sizeof(int));
+	jobs = ecalloc(nt, sizeof(SortJob));
+	bounds = ecalloc(nt + 1, sizeof(int));
+	for(i = 0; i <= nt; ++i)
+		bounds[i] = (long long)v->nitems * i / nt;
+	for(i = 0; i < nt; ++i) {
+		jobs[i] = (SortJob){.s = &s, .src = v->order, .dst = tmp,
+			.lo = bounds[i], .hi = bounds[i + 1]};
+		jobs[i].spawned = (nt > 1 && !pthread_create(&jobs[i].tid, NULL, msort_job, &jobs[i]));
+		if(!jobs[i].spawned)
+			msort_job(&jobs[i]);
+	}
+	for(i = 0; i < nt; ++i)
+		if(jobs[i].spawned)
+			pthread_join(jobs[i].tid, NULL);
+	for(src = v->order, dst = tmp, w = 1; w < nt; w *= 2) {
+		for(i = 0; i < nt; i += 2 * w) {
+			jobs[i] = (SortJob){.s = &s, .src = src, .dst = dst, .lo = bounds[i],
+				.mid = bounds[(i + w < nt ? i + w : nt)],
+				.hi = bounds[(i + 2 * w < nt ? i + 2 * w : nt)]};
+			jobs[i].spawned = !pthread_create(&jobs[i].tid, NULL, merge_job, &jobs[i]);
+			if(!jobs[i].spawned)
+				merge_job(&jobs[i]);
+		}
+		for(i = 0; i < nt; i += 2 * w)
+			if(jobs[i].spawned)
+				pthread_join(jobs[i].tid, NULL);
+		swp = src;
+		src = dst;
+		dst = swp;
+	}
+	if(src != v->order)
+		memcpy(v->order, src, v->nitems * sizeof(int));
+	free(bounds);
+	free(jobs);
+	rowfree(tmp);
+	rowfree(s.keys);
+}
+
+void
+sortview(const Arg *arg) {
+	Field *fld;
+	char col[MYSQLIDLEN] = "", *end;
+	char *hit;
+	int id = -1, c, i, n;
+
+	if(!(selview && selview->all))
+		return;
+	if(selview->nfields > 1) {
+		for(fld = selview->fields, i = 1; fld && i < selview->sortcol; fld = fld->next, ++i);
+		if(fld && selview->sortcol)
+			snprintf(col, sizeof col, "%s", fld->name);
+		if(ui_input((arg->i > 0 ? "Sort by column: " : "Reverse sort by column: "),
+				col, sizeof col, 0, NULL) <= 0)
+			return;
+		c = strtol(col, &end, 10);
+		if(*end || c < 1 || c > selview->nfields)
+			for(fld = selview->fields, c = 1; fld && strcasecmp(fld->name, col);
+					fld = fld->next, ++c);
+		if(c < 1 || c > selview->nfields) {
+			ui_set("status", "No such column: %s.", col);
+			return;
+		}
+	}
+	else
+		c = 1;
+	if(selview->nrows)
+		id = selview->rows[selview->cur];
+	selview->sortcol = c;
+	selview->sortdir = arg->i;
+	sortrows(selview);
+	/* keep the listed rows, in the new order */
+	hit = rowalloc(selview, selview->nitems, 1);
+	for(i = 0; i < selview->nrows; ++i)
+		hit[selview->rows[i]] = 1;
+	for(i = n = 0; i < selview->nitems; ++i)
+		if(hit[selview->order[i]])
+			selview->rows[n++] = selview->order[i];
+	rowfree(hit);
+	for(i = 0; i < selview->nrows && selview->rows[i] != id; ++i);
+	selview->cur = (i < selview->nrows ? i : 0);
+	ui_showitems(selview->lens);
+	setpos(selview->cur);
+}
+
+/* Open a temporary file for rows spilled, in spilldir: tmpfile() would put
+ * it in /tmp. It is unlinked at once and goes away once closed and unmapped. */
+FILE *
+spillfile(void) {
+	char path[PATH_MAX];
+	FILE *fp;
 	int fd;
-	char tmpf[] = "/tmp/myadm.XXXXXX";
 
-        fd = mkstemp(tmpf);
-	if(fd == -1) {
+	if(spilldir)
+		snprintf(path, sizeof path, "%s/spill.XXXXXX", spilldir);
+	else
+		cachepath("spill.XXXXXX", path, sizeof path);
+	cachedirs(path);
+	if((fd = mkstemp(path)) == -1)
+		return NULL;
+	unlink(path);
+	if(!(fp = fdopen(fd, "w+")))
+		close(fd);
+	return fp;
+}
+
+/* Edit the query of the SQL console, or the last one run, and run it. */
+void
+sqledit(const Arg *arg) {
+	char tmpf[] = "/tmp/myadm.XXXXXX", sql[MAXQUERYLEN+1], *p;
+	const char *old;
+	int fd, len;
+
+	old = (ISCURVIEW("sql") && selview->query ? selview->query : (histlen ? histget(0) : ""));
+	if((fd = mkstemp(tmpf)) == -1) {
 		ui_set("status", "Cannot make a temporary file.");
 		return;
 	}
-        if(write(fd, sql, strlen(sql)) == -1) {
+	if(write(fd, old, strlen(old)) == -1) {
 		close(fd);
 		unlink(tmpf);
 		ui_set("status", "Cannot write into the temporary file.");
-		return;
-	}
-	close(fd);
-	stat(tmpf, &sb);
-	while(1) {
-		editfile(tmpf);
-		stat(tmpf, &sa);
-		if(!sa.st_size || sb.st_mtime == sa.st_mtime) {
-			ui_set("status", "No changes.");
-			break;
-		}
-		if(mysql_file_exec(tmpf) < 0) {
-			if(*mysql_error(mysql)) {
-				if(ui_ask("An error occurred. Continue editing ([y]/n)?", "yn") == 'y')
-					continue;
-			}
-			else
-				ui_set("status", "Something went wrong.");
-			break;
-		}
-		reload(NULL);
-		ui_set("status", "Updated.");
-		break;
+		return;
+	}
+	close(fd);
+	editfile(tmpf);
+	len = -1;
+	if((fd = open(tmpf, O_RDONLY)) != -1) {
+		len = read(fd, sql, sizeof sql);
+		close(fd);
 	}
 	unlink(tmpf);
+	if(len < 0 || len > MAXQUERYLEN) {
+		ui_set("status", (len < 0 ? "Cannot read the temporary file." : "Query too long."));
+		return;
+	}
+	/* one statement, without the blanks and semicolon around it */
+	for(sql[len] = '\0'; len && (isspace((unsigned char)sql[len - 1]) || sql[len - 1] == ';');)
+		sql[--len] = '\0';
+	for(p = sql; isspace((unsigned char)*p); ++p);
+	if(!*p) {
+		ui_set("status", "No query.");
+		return;
+	}
+	sqlrun(p);
 }
 
 void
-quit(const Arg *arg) {
-	if(arg->i && ui_ask("Do you want to quit ([y]/n)?", "yn") != 'y')
+sqlprompt(const Arg *arg) {
+	char sql[MAXQUERYLEN+1] = "";
+
+	if(ui_input("SQL: ", sql, sizeof sql, 1, NULL) <= 0)
 		return;
-	running = 0;
+	sqlrun(sql);
 }
 
+/* Run a query in the SQL console, opening it unless it is the current view. */
 void
-reload(const Arg *arg) {
-	if(!selview->show)
-		return;
-	selview->show();
-	if(selview->cur)
-		ui_set("pos", "%d", selview->cur);
+sqlrun(const char *sql) {
+	histadd(sql);
+	histsave();
+	if(!ISCURVIEW("sql"))
+		setview("sql", NULL);
+	free(selview->query);
+	selview->query = strdup(sql);
+	selview->show = viewsql_show;
+	selview->cur = selview->top = 0;
+	selview->sortcol = 0;
+	selview->filter[0] = '\0';
+	reload(NULL);
 }
 
+/* Bring the UI up at once and connect in the background meanwhile, see
+ * startup(). */
 void
-run(void) {
-	int code, i;
+setup(void) {
+	tstart = now();
+	setlocale(LC_CTYPE, "");
+	fldseplen = strlen(FLDSEP);
+	showstatus = statusdefault;
+	histload();
+	if(mysql_library_init(0, NULL, NULL))
+		die("Cannot initialize the MySQL library.\n");
+	starting = 1;
+	startspawned = !pthread_create(&startthread, NULL, startup_job, NULL);
+	if(!startspawned)
+		startup_job(NULL);
+	ui_init();
+	splash = ui_getform(FRAG_ITEMS);
+	ui_set("title", "Connecting to `%s`", profiles[0].host);
+	tui = now() - tstart;
+}
 
-	while(running) {
-		ui_refresh();
-		code = getch();
-		if(code < 0)
+/* Called from run() once startup_job() is over: the first views are shown,
+ * from the results it prefetched when they match. */
+void
+startup(void) {
+	unsigned int i;
+
+	if(startspawned)
+		pthread_join(startthread, NULL);
+	starting = 0;
+	if(!conns[0]) {
+		ui_end();
+		die("Cannot connect to the database: %s\n", starterr);
+	}
+	useconn(0);
+	for(i = 0; i < LENGTH(actions); i++)
+		actions[i].cmd();
+	for(i = 0; i < LENGTH(actions); i++) {
+		if(prefetched[i])
+			mysql_free_result(prefetched[i]);
+		prefetched[i] = NULL;
+	}
+	stfl_free(splash);
+	splash = NULL;
+	tview = now() - tstart;
+	if(verbose)
+		ui_set("status", "Startup: ui %.0fms, connect %.0fms, prefetch %.0fms, first view %.0fms",
+			tui * 1000, tconnect * 1000, tprefetch * 1000, tview * 1000);
+}
+
+void *
+startup_job(void *arg) {
+	MYSQL *m;
+	double t;
+	int i;
+
+	mysql_thread_init();
+	t = now();
+	m = dbconnect(0, starterr, sizeof starterr);
+	tconnect = now() - t;
+	for(i = 0, t = now(); m && i < LENGTH(actions); ++i)
+		if(actions[i].query && !mysql_query(m, actions[i].query))
+			prefetched[i] = mysql_store_result(m);
+	tprefetch = now() - t;
+	mysql_thread_end();
+	pthread_mutex_lock(&startlock);
+	started = 1;
+	pthread_mutex_unlock(&startlock);
+	return NULL;
+}
+
+/* Display width of s[0..len), non printable characters counting as one
+ * column as they are shown as blanks. */
+int
+strwidth(const char *s, int len) {
+	mbstate_t ps;
+	wchar_t wc;
+	size_t n;
+	int w = 0, cw, i;
+
+	if(isprintascii(s, len))
+		return len;
+	memset(&ps, 0, sizeof ps);
+	for(i = 0; i < len; i += n) {
+		n = mbrtowc(&wc, &s[i], len - i, &ps);
+		if(n == (size_t)-1 || n == (size_t)-2 || !n) {
+			memset(&ps, 0, sizeof ps);
+			n = 1;
+			++w;
 			continue;
-		for(i = 0; i < LENGTH(keys); ++i) {
-			if(ISCURVIEW(keys[i].view) && keys[i].code == code) {
-				ui_set("status", "");
-				keys[i].func(&keys[i].arg);
-				break;
-			}
 		}
+		w += (iswprint(wc) && (cw = wcwidth(wc)) >= 0 ? cw : 1);
 	}
+	return w;
 }
 
+/* Show or hide the status columns of the tables view. */
 void
-setview(const char *name, void (*show)(void)) {
-	View *v;
-
-	v = ecalloc(1, sizeof(View));
-	v->choice = getitem(0);
-	strncpy(v->name, name, sizeof v->name);
-	v->show = show;
-	attach(v);
-	selview = v;
-	show();
+tablestatus(const Arg *arg) {
+	showstatus = !showstatus;
+	cleanupfields(&selview->fields);
+	selview->nfields = 0;
+	selview->sortcol = 0;
+	reload(NULL);
 }
 
-void
-setup(void) {
-	setlocale(LC_CTYPE, "");
-	mysql = mysql_init(NULL);
-	if(mysql_real_connect(mysql, dbhost, dbuser, dbpass, NULL, 0, NULL, 0) == NULL)
-		die("Cannot connect to the database.\n");
-	fldseplen = strlen(FLDSEP);
-	ui_init();
+/* List the transactions along with the one each waits on, from
+ * performance_schema or, before MySQL 8.0, information_schema. The error kept
+ * is the first one, the second query failing too being no news. */
+void *
+trx_job(void *arg) {
+	TrxJob *j = arg;
+	const char *waits[] = {
+		"select min(w.BLOCKING_ENGINE_TRANSACTION_ID) from "
+		"performance_schema.data_lock_waits w "
+		"where w.REQUESTING_ENGINE_TRANSACTION_ID = t.trx_id",
+		/* before MySQL 8.0 */
+		"select min(w.blocking_trx_id) from information_schema.INNODB_LOCK_WAITS w "
+		"where w.requesting_trx_id = t.trx_id",
+	};
+	char sql[MAXQUERYLEN+1], err[sizeof j->err] = "";
+	MYSQL_RES *res = NULL;
+	int i;
+
+	mysql_thread_init();
+	if(!j->m)
+		j->m = dbopen(j->conn, err, sizeof err);
+	for(i = 0; j->m && i < LENGTH(waits) && !res; ++i) {
+		snprintf(sql, sizeof sql, "select t.trx_id, (%s), t.trx_mysql_thread_id, "
+			"p.USER, p.HOST, p.DB, t.trx_state, "
+			"timestampdiff(second, t.trx_started, now()), t.trx_rows_locked, "
+			"t.trx_rows_modified, coalesce(t.trx_query, p.INFO) "
+			"from information_schema.INNODB_TRX t left join information_schema.PROCESSLIST p "
+			"on p.ID = t.trx_mysql_thread_id order by t.trx_started", waits[i]);
+		if((mysql_query(j->m, sql) || !(res = mysql_store_result(j->m))) && !*err)
+			snprintf(err, sizeof err, "%s", mysql_error(j->m));
+	}
+	if(!res && j->m) {
+		/* connected again next time, in case it was lost */
+		mysql_close(j->m);
+		j->m = NULL;
+	}
+	mysql_thread_end();
+	pthread_mutex_lock(&trxlock);
+	j->res = res;
+	memcpy(j->err, err, sizeof err);
+	j->state = 2;
+	pthread_mutex_unlock(&trxlock);
+	return NULL;
 }
 
+/* Pick up the transactions listed in the background, into the locks view if
+ * it is still the one shown. */
 void
-startup(void) {
-	for(unsigned int i = 0; i < LENGTH(actions); i++)
-		actions[i].cmd();
+trxpoll(void) {
+	int done;
+
+	if(!trxjob.state)
+		return;
+	pthread_mutex_lock(&trxlock);
+	done = (trxjob.state == 2);
+	pthread_mutex_unlock(&trxlock);
+	if(!done)
+		return;
+	pthread_join(trxjob.tid, NULL);
+	trxjob.state = 0;
+	if(selview && selview->show == viewlocks_show && selview->conn == trxjob.conn) {
+		lockstree(selview, trxjob.res, trxjob.err);
+		ui_listview(selview->items, selview->fields);
+		ui_set("title", "Transactions and lock waits@%s, every %gs",
+			profiles[selview->conn].name, selview->watch);
+		setpos(selview->cur);
+	}
+	if(trxjob.res)
+		mysql_free_result(trxjob.res);
+	trxjob.res = NULL;
 }
 
 void
 ui_end(void) {
 	stfl_reset();
 	stfl_ipool_destroy(ipool);
+	free(frame);
 }
 
 struct stfl_form *
@@ -760,70 +3910,261 @@ ui_init(void) {
 	ipool = stfl_ipool_create(nl_langinfo(CODESET));
 }
 
-void
-ui_modify(const char *name, const char *mode, const char *fmtstr, ...) {
-	va_list ap;
-	char txt[1024];
+/* Read a line into buf, echoing it on the status bar. update() is called each
+ * time the line changes. Returns the line length or -1 if aborted. */
+int
+ui_input(const char *prompt, char *buf, int sz, int hist, void (*update)(const char *)) {
+	int c, len = strlen(buf), h = -1;
 
-	if(!selview->form)
-		return;
-	va_start(ap, fmtstr);
-	vsnprintf(txt, sizeof txt, fmtstr, ap);
-	va_end(ap);
-	stfl_modify(selview->form,
-		stfl_ipool_towc(ipool, name),
-		stfl_ipool_towc(ipool, mode),
-		stfl_ipool_towc(ipool, txt));
+	while(1) {
+		ui_set("status", "%s%s", prompt, buf);
+		ui_refresh();
+		c = getch();
+		if(c == '\n')
+			break;
+		if(c == 27 || c == CTRL('g')) {
+			ui_set("status", "");
+			return -1;
+		}
+		if(c == KEY_BACKSPACE || c == 127 || c == CTRL('h')) {
+			if(!len)
+				continue;
+			while(len > 1 && (buf[len - 1] & 0xC0) == 0x80)
+				--len; /* drop a whole UTF-8 sequence */
+			buf[--len] = '\0';
+		}
+		else if(c == CTRL('u'))
+			buf[len = 0] = '\0';
+		else if(hist && (c == KEY_UP || c == KEY_DOWN)) {
+			/* walk the SQL history, newest first */
+			h += (c == KEY_UP ? (h + 1 < histlen) : -(h >= 0));
+			snprintf(buf, sz, "%s", (h >= 0 ? histget(h) : ""));
+			len = strlen(buf);
+		}
+		else if(c >= ' ' && c < 256 && c != 127 && len < sz - 1) {
+			buf[len++] = c;
+			buf[len] = '\0';
+		}
+		else
+			continue;
+		if(update)
+			update(buf);
+	}
+	ui_set("status", "");
+	return len;
+}
+
+int
+ui_listheight(void) {
+	int h;
+
+	/* title, info and status bars, plus the fields bar when shown */
+	h = LINES - 3 - (selview && selview->fields ? 1 : 0);
+	return (h > 0 ? h : 1);
 }
 
 void
-ui_putitem(Item *item, int *lens, int id) {
-	char line[COLS + 1];
-	int pad, li = 0, i, j;
+ui_putitem(Item *item, int *lens, int id, int hl) {
+	char line[COLS * MB_LEN_MAX + 1];
+	wchar_t tag[32];
+	int li = 0, col = 0, i, j, w;
 
 	if(!(item && lens))
 		return;
 	line[0] = '\0';
-	for(i = 0; i < item->ncols && li < COLS; ++i) {
+	for(i = 0; i < item->ncols && col < COLS; ++i) {
 		if(i)
-			for(j = 0; j < fldseplen && li < COLS; ++j)
+			for(j = 0; j < fldseplen && col < COLS; ++j, ++col)
 				line[li++] = FLDSEP[j];
-		pad = li;
-		for(j = 0; j < item->lens[i] && j < lens[i] && li < COLS; ++j)
-			line[li++] = (isprint(item->cols[i][j])
-					? item->cols[i][j]
-					: ' ');
-		pad = li - pad;
-		while(pad++ < lens[i] && li < COLS)
-			line[li++] = ' ';
+		w = (lens[i] < COLS - col ? lens[i] : COLS - col);
+		li += putcell(&line[li], sizeof line - li, ITEMCOL(item, i), ITEMLEN(item, i), w);
+		col += w;
 	}
-	line[li] = '\0';
-	ui_modify("items", "append", "listitem[%d] text:%s", id, QUOTE(line));
+	swprintf(tag, LENGTH(tag), L"{listitem[%d] text:\"", id);
+	framewcs(tag);
+	if(hl)
+		framewcs(L"<changed>");
+	frameputs(line, li, 1);
+	framewcs(hl ? L"</>\"}" : L"\"}");
 }
 
 void
 ui_refresh(void) {
 	if(selview && selview->form)
 		stfl_run(selview->form, -1);
+	else if(splash)
+		stfl_run(splash, -1);
+	/* strings converted for the frame are not needed anymore */
+	stfl_ipool_flush(ipool);
 }
 
 void
 ui_set(const char *key, const char *fmtstr, ...) {
 	va_list ap;
 	char val[256];
+	struct stfl_form *form = (selview ? selview->form : splash);
 
-	if(!selview)
+	if(!form)
 		return;
 
 	va_start(ap, fmtstr);
 	vsnprintf(val, sizeof val, fmtstr, ap);
 	va_end(ap);
-	stfl_set(selview->form, stfl_ipool_towc(ipool, key), stfl_ipool_towc(ipool, val));
+	stfl_set(form, stfl_ipool_towc(ipool, key), stfl_ipool_towc(ipool, val));
 }
 
 void
 usage(void) {
-	die("Usage: %s [-vhup <arg>]\n", argv0);
+	die("Usage: %s [-vV] [-h <host>] [-u <user>] [-p <pass>]\n", argv0);
+}
+
+void
+useconn(int conn) {
+	curconn = conn;
+	mysql = conns[conn];
+}
+
+/* Memory held by the items of a view, mapped rows excepted. */
+size_t
+viewbytes(View *v) {
+	size_t n;
+
+	n = v->ram + v->nram * sizeof(Item *);
+	/* the per row arrays of views with rows spilled are mapped */
+	if(!v->spill)
+		n += v->nitems * 2 * sizeof(int) + (v->soff ? (v->nitems + 1) * sizeof(size_t) : 0);
+	if(!v->sbufmapped)
+		n += v->sbufsz;
+	return n;
+}
+
+void
+viewcompare(const Arg *arg) {
+	int peer = selview->peer;
+
+	if(!getitem(0)) {
+		ui_set("status", "No table selected.");
+		return;
+	}
+	setview("compare", NULL);
+	selview->peer = peer;
+	selview->show = viewcompare_show;
+	reload(NULL);
+}
+
+/* Compare a table, listing the rows which differ between the two servers. */
+void
+viewcompare_show(void) {
+	Compare c;
+	Item **tail;
+	char *db = ITEMCOL(selview->next->choice, 0), *tbl = ITEMCOL(selview->choice, 0);
+	int ndiff = 0, i, n;
+	double t = now();
+
+	cleanuprows(selview);
+	cleanupitems(&selview->items);
+	cleanupspill(selview);
+	cleanupfields(&selview->fields);
+	selview->nitems = 0;
+	tail = &selview->items;
+	if(!compareopen(&c, selview->conn, selview->peer) && !compareinit(&c, db, tbl)
+	&& !comparerun(&c)) {
+		/* only the chunks which differ are looked into */
+		for(i = 0; i < c.nchunks; ++i) {
+			if(c.chunks[i].count[0] == c.chunks[i].count[1]
+			&& c.chunks[i].sum[0] == c.chunks[i].sum[1])
+				continue;
+			++ndiff;
+			if((n = comparerows(&c, i, selview, &tail)) < 0)
+				break;
+			selview->nitems += n;
+		}
+	}
+	selview->fields = c.fields;
+	selview->nfields = c.nfields;
+	c.fields = NULL;
+	mkrows(selview);
+	ui_listview(selview->items, selview->fields);
+	ui_set("title", "`%s`.`%s` on %s and %s: %d chunk(s), %d differ, %d row(s), %.3fs",
+		db, tbl, profiles[selview->conn].name, profiles[selview->peer].name,
+		c.nchunks, ndiff, selview->nitems, now() - t);
+	if(*c.err)
+		ui_set("status", "%s", c.err);
+	compareclose(&c);
+}
+
+/* Compare all the tables of a database, by chunks only. */
+void
+viewcomparedb_show(void) {
+	Compare c;
+	MYSQL_RES *res;
+	MYSQL_ROW row;
+	Item **tail;
+	char *db = ITEMCOL(selview->choice, 0), name[MYSQLIDLEN], num[4][32], *cols[6];
+	unsigned long lens[6];
+	unsigned long long nrows[2];
+	int ndiff, nbad = 0, r, i, j;
+	double t = now();
+
+	cleanuprows(selview);
+	cleanupitems(&selview->items);
+	cleanupspill(selview);
+	cleanupfields(&selview->fields);
+	attachfield(mkfield("table", MYSQL_TYPE_STRING), &selview->fields);
+	attachfield(mkfield("chunks", MYSQL_TYPE_LONGLONG), &selview->fields);
+	attachfield(mkfield("differ", MYSQL_TYPE_LONGLONG), &selview->fields);
+	for(i = 0; i < 2; ++i) {
+		snprintf(name, sizeof name, "rows on %s",
+			profiles[(i ? selview->peer : selview->conn)].name);
+		attachfield(mkfield(name, MYSQL_TYPE_LONGLONG), &selview->fields);
+	}
+	attachfield(mkfield("error", MYSQL_TYPE_STRING), &selview->fields);
+	selview->nfields = LENGTH(cols);
+	selview->nitems = 0;
+	tail = &selview->items;
+	if(!compareopen(&c, selview->conn, selview->peer)) {
+		r = mysql_exec("show full tables from `%s` where Table_type = 'BASE TABLE'", db);
+		if(r == -1 || !(res = mysql_store_result(mysql)))
+			snprintf(c.err, sizeof c.err, "%s", mysql_error(mysql));
+		else {
+			while((row = mysql_fetch_row(res))) {
+				ndiff = 0;
+				nrows[0] = nrows[1] = 0;
+				if(!compareinit(&c, db, row[0]) && !comparerun(&c)) {
+					for(i = 0; i < c.nchunks; ++i) {
+						for(j = 0; j < 2; ++j)
+							nrows[j] += c.chunks[i].count[j];
+						ndiff += (c.chunks[i].count[0] != c.chunks[i].count[1]
+							|| c.chunks[i].sum[0] != c.chunks[i].sum[1]);
+					}
+				}
+				nbad += (ndiff || *c.err);
+				snprintf(num[0], sizeof num[0], "%d", c.nchunks);
+				snprintf(num[1], sizeof num[1], "%d", ndiff);
+				snprintf(num[2], sizeof num[2], "%llu", nrows[0]);
+				snprintf(num[3], sizeof num[3], "%llu", nrows[1]);
+				cols[0] = row[0];
+				for(i = 0; i < 4; ++i)
+					cols[i + 1] = num[i];
+				cols[5] = c.err;
+				for(i = 0; i < LENGTH(cols); ++i)
+					lens[i] = strlen(cols[i]);
+				*tail = mkitem(selview, cols, lens, LENGTH(cols));
+				tail = &(*tail)->next;
+				++selview->nitems;
+			}
+			mysql_free_result(res);
+			c.err[0] = '\0';
+		}
+	}
+	mkrows(selview);
+	ui_listview(selview->items, selview->fields);
+	ui_set("title", "`%s` on %s and %s: %d table(s), %d differ, %.3fs", db,
+		profiles[selview->conn].name, profiles[selview->peer].name,
+		selview->nitems, nbad, now() - t);
+	if(*c.err)
+		ui_set("status", "%s", c.err);
+	compareclose(&c);
 }
 
 void
@@ -835,7 +4176,7 @@ viewdb(const Arg *arg) {
 		ui_set("status", "No database selected.");
 		return;
 	}
-	mysql_select_db(mysql, choice->cols[0]);
+	mysql_select_db(mysql, ITEMCOL(choice, 0));
 	setview("tables", viewdb_show);
 	itempos(&a);
 }
@@ -843,13 +4184,39 @@ viewdb(const Arg *arg) {
 void
 viewdb_show(void) {
 	MYSQL_RES *res;
+	char *db = ITEMCOL(selview->choice, 0), *esc;
+	int r;
 
-	if(mysql_exec("show tables") == -1 || !(res = mysql_store_result(mysql)))
-		die("show tables");
-	mysql_fillview(res, 0);
-	mysql_free_result(res);
-	ui_listview(selview->items, NULL);
-	ui_set("title", "Tables in `%s`@%s", selview->choice->cols[0], dbhost);
+	schemarefresh(selview->conn);
+	if(showstatus) {
+		/* the whole database in one go, SHOW TABLE STATUS per table is slow */
+		esc = ecalloc(strlen(db) * 2 + 1, 1);
+		mysql_real_escape_string(mysql, esc, db, strlen(db));
+		r = mysql_exec("select TABLE_NAME as Name, ENGINE as Engine, "
+			"TABLE_ROWS as `Rows`, DATA_LENGTH + INDEX_LENGTH as Size, "
+			"DATA_LENGTH as Data, INDEX_LENGTH as `Index`, DATA_FREE as Free "
+			"from information_schema.TABLES where TABLE_SCHEMA = '%s' "
+			"order by TABLE_NAME", esc);
+		free(esc);
+		if(r == -1 || !(res = mysql_store_result(mysql)))
+			die("table status of `%s`", db);
+		mysql_fillview(res, 1);
+		mysql_free_result(res);
+	}
+	else {
+		/* no header above the names, nor a line kept for it */
+		cleanupfields(&selview->fields);
+		selview->nfields = 0;
+	}
+	if(!showstatus && schemafill(selview, db)) {
+		if(mysql_exec("show tables") == -1 || !(res = mysql_store_result(mysql)))
+			die("show tables");
+		mysql_fillview(res, 0);
+		mysql_free_result(res);
+	}
+	ui_listview(selview->items, selview->fields);
+	ui_set("title", "Tables in `%s`@%s", ITEMCOL(selview->choice, 0),
+		profiles[selview->conn].host);
 }
 
 void
@@ -864,12 +4231,184 @@ void
 viewdblist_show(void) {
 	MYSQL_RES *res;
 
-	if(mysql_exec("show databases") == -1 || !(res = mysql_store_result(mysql)))
-		die("show databases");
-	mysql_fillview(res, 0);
-	mysql_free_result(res);
+	if(!schemas[selview->conn].map && schemas[selview->conn].state != 1)
+		schemaopen(selview->conn);
+	schemarefresh(selview->conn);
+	if(schemafill(selview, NULL)) {
+		if(!(res = mysql_store("show databases")))
+			die("show databases");
+		mysql_fillview(res, 0);
+		mysql_free_result(res);
+	}
 	ui_listview(selview->items, NULL);
-	ui_set("title", "Databases in `%s`", dbhost);
+	ui_set("title", "Databases in `%s`", profiles[selview->conn].host);
+}
+
+/* Run the query of the view on every profile at once, one thread and one
+ * connection each, and list all the rows prefixed by the profile name. */
+void
+viewfanout_show(void) {
+	FanJob *jobs;
+	MYSQL_ROW row;
+	Item **tail;
+	char **cols;
+	unsigned long *lens, *rlens;
+	int nfds = 0, nfail = 0, i, j, n;
+	double t = now();
+
+	jobs = ecalloc(LENGTH(profiles), sizeof(FanJob));
+	for(i = 0; i < LENGTH(profiles); ++i) {
+		jobs[i].conn = i;
+		jobs[i].sql = selview->query;
+		jobs[i].spawned = !pthread_create(&jobs[i].tid, NULL, fanout_job, &jobs[i]);
+		if(!jobs[i].spawned)
+			fanout_job(&jobs[i]);
+	}
+	for(i = 0; i < LENGTH(profiles); ++i)
+		if(jobs[i].spawned)
+			pthread_join(jobs[i].tid, NULL);
+	t = now() - t;
+
+	cleanuprows(selview);
+	cleanupitems(&selview->items);
+	cleanupspill(selview);
+	cleanupfields(&selview->fields);
+	attachfield(mkfield("server", MYSQL_TYPE_STRING), &selview->fields);
+	for(i = 0; i < LENGTH(profiles) && !jobs[i].res; ++i);
+	if(i < LENGTH(profiles))
+		nfds = mysql_fields(jobs[i].res, &selview->fields);
+	else
+		attachfield(mkfield("error", MYSQL_TYPE_STRING), &selview->fields);
+	n = (nfds ? nfds : 1) + 1;
+	cols = ecalloc(n, sizeof(char *));
+	lens = ecalloc(n, sizeof(unsigned long));
+	selview->nitems = 0;
+	for(tail = &selview->items, i = 0; i < LENGTH(profiles); ++i) {
+		cols[0] = (char *)profiles[i].name;
+		lens[0] = strlen(cols[0]);
+		if(!jobs[i].res) {
+			++nfail;
+			for(j = 1; j < n; ++j) {
+				cols[j] = (j == 1 ? jobs[i].err : "");
+				lens[j] = strlen(cols[j]);
+			}
+			*tail = mkitem(selview, cols, lens, n);
+			tail = &(*tail)->next;
+			++selview->nitems;
+			continue;
+		}
+		while((row = mysql_fetch_row(jobs[i].res))) {
+			rlens = mysql_fetch_lengths(jobs[i].res);
+			for(j = 1; j < n; ++j) {
+				cols[j] = (j - 1 < mysql_num_fields(jobs[i].res) ? row[j - 1] : NULL);
+				lens[j] = (cols[j] ? rlens[j - 1] : 0);
+			}
+			*tail = mkitem(selview, cols, lens, n);
+			tail = &(*tail)->next;
+			++selview->nitems;
+		}
+		mysql_free_result(jobs[i].res);
+	}
+	selview->nfields = n;
+	free(lens);
+	free(cols);
+	free(jobs);
+	mkrows(selview);
+	ui_listview(selview->items, selview->fields);
+	ui_set("title", "%s on %d server(s), %d failed, %.3fs",
+		selview->query, (int)LENGTH(profiles), nfail, t);
+}
+
+void
+viewserver(const Arg *arg) {
+	Arg a = {.i = 0};
+	char err[256];
+	int conn;
+
+	if(!getitem(0)) {
+		ui_set("status", "No server selected.");
+		return;
+	}
+	conn = selview->rows[selview->cur];
+	if(!dbconnect(conn, err, sizeof err)) {
+		ui_set("status", "Cannot connect to `%s`: %s", profiles[conn].name, err);
+		return;
+	}
+	useconn(conn);
+	viewdblist();
+	itempos(&a);
+}
+
+void
+viewserverlist(void) {
+	Arg a = {.i = 0};
+
+	setview("servers", viewserverlist_show);
+	itempos(&a);
+}
+
+void
+viewserverlist_show(void) {
+	const char *fds[] = { "name", "host", "user", "state" };
+	char *cols[LENGTH(fds)];
+	unsigned long lens[LENGTH(fds)];
+	Item **tail;
+	int i, j;
+
+	cleanuprows(selview);
+	cleanupitems(&selview->items);
+	cleanupspill(selview);
+	cleanupfields(&selview->fields);
+	for(i = 0; i < LENGTH(fds); ++i)
+		attachfield(mkfield(fds[i], MYSQL_TYPE_STRING), &selview->fields);
+	selview->nfields = LENGTH(fds);
+	for(tail = &selview->items, i = 0; i < LENGTH(profiles); ++i) {
+		cols[0] = (char *)profiles[i].name;
+		cols[1] = (char *)profiles[i].host;
+		cols[2] = (char *)profiles[i].user;
+		cols[3] = (conns[i] ? "connected" : "");
+		for(j = 0; j < LENGTH(fds); ++j)
+			lens[j] = strlen(cols[j]);
+		*tail = mkitem(selview, cols, lens, LENGTH(fds));
+		tail = &(*tail)->next;
+	}
+	selview->nitems = LENGTH(profiles);
+	mkrows(selview);
+	ui_listview(selview->items, selview->fields);
+	ui_set("title", "Servers");
+}
+
+void
+viewlocks(const Arg *arg) {
+	Arg a = {.i = 0};
+
+	setview("locks", viewlocks_show);
+	selview->watch = lockinterval;
+	selview->watched = now();
+	itempos(&a);
+}
+
+/* Start listing the transactions of the profile of the view in the
+ * background, unless already going on; the list is filled by trxpoll(). */
+void
+viewlocks_show(void) {
+	if(!selview->form) {
+		mkrows(selview);
+		ui_listview(selview->items, selview->fields);
+		ui_set("title", "Transactions and lock waits@%s...", profiles[selview->conn].name);
+	}
+	if(trxjob.state)
+		return;
+	if(trxjob.m && trxjob.conn != selview->conn) {
+		mysql_close(trxjob.m);
+		trxjob.m = NULL;
+	}
+	trxjob.conn = selview->conn;
+	trxjob.state = 1;
+	if(pthread_create(&trxjob.tid, NULL, trx_job, &trxjob)) {
+		trxjob.state = 0;
+		ui_set("status", "Cannot start a thread.");
+	}
 }
 
 void
@@ -881,6 +4420,74 @@ viewprev(const Arg *arg) {
 	v = selview->next;
 	cleanupview(selview);
 	selview = v;
+	selview->used = ++tick;
+	useconn(selview->conn);
+	/* USE in the SQL console changes the database under the views below */
+	for(v = selview; v && !(v->show == viewdb_show && v->conn == selview->conn); v = v->next);
+	if(v)
+		mysql_select_db(mysql, ITEMCOL(v->choice, 0));
+	if(selview->evicted) {
+		selview->evicted = 0;
+		reload(NULL);
+	}
+	else
+		setpos(selview->cur);
+}
+
+/* Run the query of the SQL console. Results are streamed into the view like
+ * the records of a table; statements without any get a single row telling
+ * how many rows they affected and are not run again on reload. */
+void
+viewsql_show(void) {
+	MYSQL_RES *res = NULL;
+	char *cols[2], num[32];
+	unsigned long lens[2];
+	double t = now();
+	int err;
+
+	err = (mysql_real_query(mysql, selview->query, strlen(selview->query))
+		|| (!(res = mysql_use_result(mysql)) && mysql_field_count(mysql)));
+	if(res) {
+		mysql_fillview(res, 1);
+		err = mysql_errno(mysql);
+		mysql_free_result(res);
+	}
+	else {
+		cleanuprows(selview);
+		cleanupitems(&selview->items);
+		cleanupspill(selview);
+		cleanupfields(&selview->fields);
+		if(err) {
+			attachfield(mkfield("error", MYSQL_TYPE_STRING), &selview->fields);
+			cols[0] = (char *)mysql_error(mysql);
+			selview->nfields = 1;
+		}
+		else {
+			attachfield(mkfield("affected rows", MYSQL_TYPE_LONGLONG), &selview->fields);
+			attachfield(mkfield("info", MYSQL_TYPE_STRING), &selview->fields);
+			snprintf(num, sizeof num, "%llu", (unsigned long long)mysql_affected_rows(mysql));
+			cols[0] = num;
+			cols[1] = (char *)(mysql_info(mysql) ? mysql_info(mysql) : "");
+			lens[1] = strlen(cols[1]);
+			selview->nfields = 2;
+			selview->show = NULL;
+		}
+		lens[0] = strlen(cols[0]);
+		selview->items = mkitem(selview, cols, lens, selview->nfields);
+		selview->nitems = 1;
+		mkrows(selview);
+	}
+	t = now() - t;
+	ui_listview(selview->items, selview->fields);
+	ui_set("title", "%s@%s: %d row(s), %.3fs", selview->query,
+		profiles[selview->conn].host, (res ? selview->nitems : 0), t);
+	if(res && err)
+		ui_set("status", "%s", mysql_error(mysql));
+	/* the results following the first, of a CALL say, are not shown but must
+	 * be read for the connection to be of use again */
+	while(!mysql_next_result(mysql))
+		if((res = mysql_store_result(mysql)))
+			mysql_free_result(res);
 }
 
 void
@@ -897,38 +4504,166 @@ viewtable(const Arg *arg) {
 
 void
 viewtable_show(void) {
-	MYSQL_RES *res;
+	MYSQL_RES *res = NULL;
+	char err[256] = "", *col;
+	unsigned long len;
 	int r;
 
-	r = mysql_exec("select * from `%s`", selview->choice->cols[0]);
-	if(r == -1 || !(res = mysql_store_result(mysql)))
-		die("select from `%s`", selview->choice->cols[0]);
-	mysql_fillview(res, 1);
-	mysql_free_result(res);
+	r = mysql_exec("select * from `%s` %s", ITEMCOL(selview->choice, 0), selview->where);
+	/* streamed, large tables may not fit in memory twice */
+	if(r != -1 && (res = mysql_use_result(mysql))) {
+		mysql_fillview(res, 1);
+		mysql_free_result(res);
+	}
+	/* the table dropped or the connection lost, while watched say */
+	if(mysql_errno(mysql)) {
+		snprintf(err, sizeof err, "%s", mysql_error(mysql));
+		selview->watch = 0;
+	}
+	if(!res) {
+		cleanuprows(selview);
+		cleanupitems(&selview->items);
+		cleanupspill(selview);
+		cleanupfields(&selview->fields);
+		attachfield(mkfield("error", MYSQL_TYPE_STRING), &selview->fields);
+		col = err;
+		len = strlen(col);
+		selview->nfields = 1;
+		selview->items = mkitem(selview, &col, &len, 1);
+		selview->nitems = 1;
+		mkrows(selview);
+	}
 	ui_listview(selview->items, selview->fields);
-	ui_set("title", "Records in `%s`.`%s`@%s",
-		selview->next->choice->cols[0], selview->choice->cols[0], dbhost);
+	ui_set("title", "Records in `%s`.`%s`@%s%s%s",
+		ITEMCOL(selview->next->choice, 0), ITEMCOL(selview->choice, 0),
+		profiles[selview->conn].host,
+		(*selview->where ? " " : ""), selview->where);
+	if(*err)
+		ui_set("status", "%s", err);
+}
+
+/* Refresh the current view every few seconds, highlighting the rows which
+ * were not there the last time. */
+void
+watch(const Arg *arg) {
+	char buf[32];
+	double secs;
+
+	if(!(selview && selview->show))
+		return;
+	snprintf(buf, sizeof buf, "%g", (selview->watch ? selview->watch : watchinterval));
+	if(ui_input("Watch every (seconds, 0 to stop): ", buf, sizeof buf, 0, NULL) < 0)
+		return;
+	secs = strtod(buf, NULL);
+	rowfree(selview->seen);
+	rowfree(selview->changed);
+	selview->seen = NULL;
+	selview->changed = NULL;
+	selview->probe[0] = '\0';
+	if((selview->watch = (secs > 0 ? secs : 0))) {
+		watchprobe(selview);
+		watchseen(selview);
+		selview->watched = now();
+		ui_set("status", "Watching every %gs.", selview->watch);
+	}
+	ui_showitems(selview->lens);
+}
+
+/* Flag the rows whose hash is not among the ones seen before. */
+void
+watchmark(View *v) {
+	Item tmp;
+	unsigned int h;
+	int i;
+
+	rowfree(v->changed);
+	v->changed = rowalloc(v, v->nitems + 1, 1);
+	for(i = 0; i < v->nitems; ++i) {
+		h = itemhash(rowitem(v, i, &tmp));
+		v->changed[i] = !bsearch(&h, &v->seen[1], v->seen[0], sizeof h, cmpuint);
+	}
+}
+
+void
+watchpoll(void) {
+	if(!(selview && selview->watch && selview->show)
+	|| now() - selview->watched < selview->watch)
+		return;
+	if(watchprobe(selview)) {
+		/* nothing changed, nothing to highlight either */
+		if(selview->changed) {
+			memset(selview->changed, 0, selview->nitems);
+			ui_showitems(selview->lens);
+		}
+	}
+	else {
+		/* views refreshed on their own, like locks, highlight nothing */
+		if(selview->seen)
+			watchseen(selview);
+		reload(NULL);
+	}
+	selview->watched = now();
+}
+
+/* Tell whether the table listed by v is the same as when last probed, by
+ * its checksum. CHECKSUM TABLE reads the whole table, so filtered views and
+ * tables of more than watchprobemax rows are not probed, nor other views:
+ * they are always queried again. */
+int
+watchprobe(View *v) {
+	MYSQL_RES *res;
+	MYSQL_ROW row;
+	char sum[sizeof v->probe] = "";
+	int same;
+
+	if(v->show != viewtable_show || *v->where || v->nitems > watchprobemax)
+		return 0;
+	if(mysql_exec("checksum table `%s`", ITEMCOL(v->choice, 0)) == -1
+	|| !(res = mysql_store_result(mysql)))
+		return 0;
+	if((row = mysql_fetch_row(res)) && mysql_num_fields(res) > 1 && row[1])
+		snprintf(sum, sizeof sum, "%s", row[1]);
+	mysql_free_result(res);
+	same = (*sum && !strcmp(sum, v->probe));
+	memcpy(v->probe, sum, sizeof v->probe);
+	return same;
+}
+
+/* Remember the hashes of the rows of v, sorted, the count first. */
+void
+watchseen(View *v) {
+	Item tmp;
+	int i;
+
+	rowfree(v->seen);
+	v->seen = rowalloc(v, v->nitems + 1, sizeof(unsigned int));
+	v->seen[0] = v->nitems;
+	for(i = 0; i < v->nitems; ++i)
+		v->seen[i + 1] = itemhash(rowitem(v, i, &tmp));
+	qsort(&v->seen[1], v->nitems, sizeof(unsigned int), cmpuint);
 }
 
 int
 main(int argc, char **argv) {
 	ARGBEGIN {
 	case 'h':
-		dbhost = EARGF(usage());
+		profiles[0].host = EARGF(usage());
 		break;
 	case 'u':
-		dbuser = EARGF(usage());
+		profiles[0].user = EARGF(usage());
 		break;
 	case 'p':
-		dbpass = EARGF(usage());
+		profiles[0].pass = EARGF(usage());
 		break;
 	case 'v':
-		die("%s-"VERSION, argv0);
+		verbose = 1;
+		break;
+	case 'V':
+		die("%s-"VERSION"\n", argv0);
 	default:
 		usage();
 	} ARGEND;
 	setup();
-	startup();
 	run();
 	cleanup();
 	return 0;